@@ -0,0 +1,1090 @@
+#include <assert.h>
+#include <string.h>
+#include "apu.h"
+#include "gb.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define APU_X86
+#include <emmintrin.h>
+#endif
+
+/// Master clock frequency in Hz
+#define CLOCK_RATE 4194304
+
+/// Frame sequencer period in clock cycles (512 Hz)
+#define FRAME_SEQ_PERIOD 8192
+
+/// Longest stretch of time left unsynthesized, keeps deltas within the buffer
+#define APU_SYNC_PERIOD 32768
+
+/// Number of sub-sample positions of the band-limited step
+#define KERNEL_PHASES 32
+
+/// Kernel taps of each phase sum up to 1 << KERNEL_BITS
+#define KERNEL_BITS 15
+
+/// Output samples are the integrated amplitude scaled by 64
+#define OUTPUT_SHIFT (KERNEL_BITS - 6)
+
+/// Integrator leak, removes DC offset of the unipolar channel DACs
+#define HIGH_PASS_SHIFT 12
+
+/// Resampler filter taps of each phase sum up to 1 << RESAMPLER_BITS
+#define RESAMPLER_PHASES 32
+#define RESAMPLER_BITS   14
+
+/// Register offsets from 0xFF10
+#define REG_NR10  0x00
+#define REG_NR30  0x0A
+#define REG_NR32  0x0C
+#define REG_NR43  0x12
+#define REG_NR50  0x14
+#define REG_NR51  0x15
+#define REG_NR52  0x16
+#define REG_WAVE  0x20
+
+#define NR52_POWER_BIT 7
+
+#define GET_BIT(val, bit) (((val) >> (bit)) & 0x1)
+
+/// Offset of NRx0 of the channel, NRx1-NRx4 follow it
+#define CHANNEL_REGS(index) ((index) * 5)
+
+enum
+{
+    CHANNEL_SQUARE1,
+    CHANNEL_SQUARE2,
+    CHANNEL_WAVE,
+    CHANNEL_NOISE
+};
+
+/// Bits which always read as 1
+static const uint8_t apu_read_masks[REG_WAVE] =
+{
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, // NR10-NR14
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF, // NR20-NR24
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF, // NR30-NR34
+    0xFF, 0xFF, 0x00, 0x00, 0xBF, // NR40-NR44
+    0x00, 0x00, 0x70,             // NR50-NR52
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/// Square duty cycles, the first step is the highest bit
+static const uint8_t apu_duty_patterns[] =
+{
+    0x01, // 12.5%
+    0x81, // 25%
+    0x87, // 50%
+    0x7E  // 75%
+};
+
+/// Number of high steps of the duty cycles
+static const int apu_duty_lengths[] = { 1, 2, 4, 6 };
+
+/// Wave channel volume codes as right shifts
+static const int apu_wave_shifts[] = { 4, 0, 1, 2 };
+
+/// Noise channel base periods in clock cycles
+static const int apu_noise_divisors[] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+
+/**
+ * Differences of a Blackman-windowed band-limited step at 32 sub-sample offsets.
+ * Step center is 7 samples after the delta position.
+ */
+static const int16_t apu_step_kernel[KERNEL_PHASES][APU_KERNEL_WIDTH] =
+{
+    {    18,   -110,    359,   -843,   1561,  -2371,   3025,  29490,   3025,  -2371,   1561,   -843,    359,   -110,     18,      0},
+    {    17,   -108,    347,   -795,   1421,  -2025,   2117,  29452,   3974,  -2714,   1693,   -887,    369,   -111,     18,      0},
+    {    17,   -105,    332,   -742,   1276,  -1679,   1252,  29332,   4960,  -3051,   1818,   -925,    376,   -110,     17,      0},
+    {    16,   -102,    315,   -686,   1128,  -1335,    434,  29131,   5981,  -3378,   1932,   -956,    380,   -109,     17,      0},
+    {    16,    -98,    297,   -627,    977,   -997,   -336,  28853,   7031,  -3693,   2036,   -982,    381,   -106,     16,      0},
+    {    15,    -93,    277,   -566,    824,   -665,  -1055,  28499,   8106,  -3992,   2127,   -999,    378,   -103,     15,      0},
+    {    14,    -87,    256,   -503,    672,   -343,  -1721,  28067,   9203,  -4273,   2204,  -1009,    372,    -97,     13,      0},
+    {    13,    -82,    234,   -439,    522,    -34,  -2334,  27565,  10317,  -4531,   2266,  -1011,    362,    -91,     11,      0},
+    {    12,    -76,    211,   -375,    374,    262,  -2891,  26992,  11444,  -4765,   2311,  -1004,    348,    -83,      8,      0},
+    {    10,    -69,    188,   -311,    229,    543,  -3394,  26350,  12577,  -4970,   2339,   -987,    330,    -73,      6,      0},
+    {     9,    -63,    165,   -248,     90,    807,  -3840,  25646,  13712,  -5144,   2348,   -962,    308,    -62,      2,      0},
+    {     8,    -56,    142,   -186,    -44,   1052,  -4231,  24877,  14845,  -5283,   2338,   -926,    282,    -50,     -1,      1},
+    {     7,    -50,    119,   -126,   -171,   1277,  -4566,  24057,  15970,  -5386,   2307,   -881,    251,    -36,     -5,      1},
+    {     6,    -44,     96,    -68,   -291,   1482,  -4846,  23182,  17081,  -5448,   2255,   -825,    217,    -21,    -10,      2},
+    {     5,    -37,     74,    -12,   -403,   1666,  -5072,  22257,  18174,  -5467,   2182,   -760,    178,     -4,    -15,      2},
+    {     4,    -31,     53,     41,   -506,   1828,  -5246,  21289,  19243,  -5441,   2086,   -685,    136,     14,    -20,      3},
+    {     3,    -25,     33,     90,   -600,   1968,  -5368,  20283,  20283,  -5368,   1968,   -600,     90,     33,    -25,      3},
+    {     3,    -20,     14,    136,   -685,   2086,  -5441,  19243,  21289,  -5246,   1828,   -506,     41,     53,    -31,      4},
+    {     2,    -15,     -4,    178,   -760,   2182,  -5467,  18174,  22257,  -5072,   1666,   -403,    -12,     74,    -37,      5},
+    {     2,    -10,    -21,    217,   -825,   2255,  -5448,  17081,  23182,  -4846,   1482,   -291,    -68,     96,    -44,      6},
+    {     1,     -5,    -36,    251,   -881,   2307,  -5386,  15970,  24057,  -4566,   1277,   -171,   -126,    119,    -50,      7},
+    {     1,     -1,    -50,    282,   -926,   2338,  -5283,  14845,  24877,  -4231,   1052,    -44,   -186,    142,    -56,      8},
+    {     0,      2,    -62,    308,   -962,   2348,  -5144,  13712,  25646,  -3840,    807,     90,   -248,    165,    -63,      9},
+    {     0,      6,    -73,    330,   -987,   2339,  -4970,  12577,  26350,  -3394,    543,    229,   -311,    188,    -69,     10},
+    {     0,      8,    -83,    348,  -1004,   2311,  -4765,  11444,  26992,  -2891,    262,    374,   -375,    211,    -76,     12},
+    {     0,     11,    -91,    362,  -1011,   2266,  -4531,  10317,  27565,  -2334,    -34,    522,   -439,    234,    -82,     13},
+    {     0,     13,    -97,    372,  -1009,   2204,  -4273,   9203,  28067,  -1721,   -343,    672,   -503,    256,    -87,     14},
+    {     0,     15,   -103,    378,   -999,   2127,  -3992,   8106,  28499,  -1055,   -665,    824,   -566,    277,    -93,     15},
+    {     0,     16,   -106,    381,   -982,   2036,  -3693,   7031,  28853,   -336,   -997,    977,   -627,    297,    -98,     16},
+    {     0,     17,   -109,    380,   -956,   1932,  -3378,   5981,  29131,    434,  -1335,   1128,   -686,    315,   -102,     16},
+    {     0,     17,   -110,    376,   -925,   1818,  -3051,   4960,  29332,   1252,  -1679,   1276,   -742,    332,   -105,     17},
+    {     0,     18,   -111,    369,   -887,   1693,  -2714,   3974,  29452,   2117,  -2025,   1421,   -795,    347,   -108,     17},
+};
+
+/**
+ * Interpolation filter of the resampler at 32 sub-sample offsets.
+ * Cuts off at 0.45 of the input rate, output is delayed by 3 input samples.
+ */
+static const int16_t apu_resampler_filter[RESAMPLER_PHASES][APU_RESAMPLER_TAPS] __attribute__((aligned(16))) =
+{
+    {    93,   -521,   1247,  14746,   1247,   -521,     93,      0},
+    {    80,   -433,    861,  14724,   1658,   -613,    107,      0},
+    {    68,   -349,    503,  14655,   2093,   -708,    122,      0},
+    {    56,   -269,    172,  14541,   2553,   -805,    137,     -1},
+    {    46,   -195,   -131,  14383,   3033,   -903,    152,     -1},
+    {    36,   -126,   -407,  14183,   3534,  -1001,    167,     -2},
+    {    27,    -63,   -654,  13940,   4053,  -1099,    183,     -3},
+    {    20,     -6,   -873,  13656,   4588,  -1194,    197,     -4},
+    {    13,     45,  -1065,  13334,   5136,  -1285,    211,     -5},
+    {     7,     90,  -1230,  12976,   5695,  -1372,    224,     -6},
+    {     3,    130,  -1369,  12583,   6262,  -1453,    235,     -7},
+    {    -1,    163,  -1483,  12159,   6834,  -1525,    245,     -8},
+    {    -4,    191,  -1573,  11708,   7408,  -1589,    252,     -9},
+    {    -7,    214,  -1641,  11229,   7982,  -1641,    257,     -9},
+    {    -8,    232,  -1686,  10726,   8552,  -1682,    260,    -10},
+    {    -9,    245,  -1712,  10206,   9114,  -1708,    258,    -10},
+    {   -10,    254,  -1718,   9666,   9666,  -1718,    254,    -10},
+    {   -10,    258,  -1708,   9114,  10206,  -1712,    245,     -9},
+    {   -10,    260,  -1682,   8552,  10726,  -1686,    232,     -8},
+    {    -9,    257,  -1641,   7982,  11229,  -1641,    214,     -7},
+    {    -9,    252,  -1589,   7408,  11708,  -1573,    191,     -4},
+    {    -8,    245,  -1525,   6834,  12159,  -1483,    163,     -1},
+    {    -7,    235,  -1453,   6262,  12583,  -1369,    130,      3},
+    {    -6,    224,  -1372,   5695,  12976,  -1230,     90,      7},
+    {    -5,    211,  -1285,   5136,  13334,  -1065,     45,     13},
+    {    -4,    197,  -1194,   4588,  13656,   -873,     -6,     20},
+    {    -3,    183,  -1099,   4053,  13940,   -654,    -63,     27},
+    {    -2,    167,  -1001,   3534,  14183,   -407,   -126,     36},
+    {    -1,    152,   -903,   3033,  14383,   -131,   -195,     46},
+    {    -1,    137,   -805,   2553,  14541,    172,   -269,     56},
+    {     0,    122,   -708,   2093,  14655,    503,   -349,     68},
+    {     0,    107,   -613,   1658,  14724,    861,   -433,     80},
+};
+
+static uint8_t apu_io_read(void *device);
+static void    apu_io_write(void *device, uint8_t value);
+
+/**
+ * Sets up synthesis for the current mode and sample rate, buffered sound is dropped
+ *
+ * \param apu APU instance
+ */
+static void apu_restart_output(gb_apu_t *apu);
+
+/**
+ * Synthesizes sound up to the current master clock value
+ *
+ * \param apu APU instance
+ */
+static void apu_sync(gb_apu_t *apu);
+
+/**
+ * Sets the time of the next periodic synthesis, there is none while sound is off
+ *
+ * \param apu APU instance
+ * \param now Master clock value
+ */
+static void apu_schedule_sync(gb_apu_t *apu, uint64_t now);
+
+/**
+ * Runs all channels up to the given time
+ *
+ * \param apu APU instance
+ * \param end Master clock value
+ */
+static void apu_run_channels(gb_apu_t *apu, uint64_t end);
+
+/**
+ * Runs the channel waveform up to the given time
+ *
+ * \param apu APU instance
+ * \param index Channel index
+ * \param end Master clock value
+ */
+static void apu_run_channel(gb_apu_t *apu, int index, uint64_t end);
+
+/**
+ * Runs the noise channel with steps shorter than a synthesis sample up to the given time.
+ * Each sample gets the average output of the steps it covers
+ *
+ * \param apu APU instance
+ * \param period Step period in clock cycles
+ * \param end Master clock value
+ */
+static void apu_run_fast_noise(gb_apu_t *apu, int period, uint64_t end);
+
+/**
+ * Advances the noise channel shift register by one step
+ *
+ * \param apu APU instance
+ */
+static inline void apu_noise_step(gb_apu_t *apu);
+
+/**
+ * Clocks length counters, frequency sweep and envelopes
+ *
+ * \param apu APU instance
+ * \param time Master clock value of the tick
+ */
+static void apu_frame_seq_tick(gb_apu_t *apu, uint64_t time);
+
+/**
+ * Emulates writing to NRx4 with the trigger bit set
+ *
+ * \param apu APU instance
+ * \param index Channel index
+ * \param time Master clock value
+ */
+static void apu_trigger(gb_apu_t *apu, int index, uint64_t time);
+
+/**
+ * Calculates the next frequency of the channel 1 sweep, stops the channel on overflow
+ *
+ * \param apu APU instance
+ * \return New frequency
+ */
+static int apu_sweep_next(gb_apu_t *apu);
+
+/**
+ * Returns the waveform step period of the channel
+ *
+ * \param apu APU instance
+ * \param index Channel index
+ * \return Clock cycles or 0 if the channel isn't clocked
+ */
+static int apu_channel_period(gb_apu_t *apu, int index);
+
+/**
+ * Returns the current DAC input of the channel
+ *
+ * \param apu APU instance
+ * \param index Channel index
+ * \return Amplitude (0-15)
+ */
+static int apu_channel_amp(gb_apu_t *apu, int index);
+
+/**
+ * Changes the DAC input of the channel and updates its outputs
+ *
+ * \param apu APU instance
+ * \param index Channel index
+ * \param time Master clock value of the change
+ * \param amp New amplitude (0-15)
+ */
+static void apu_channel_set_amp(gb_apu_t *apu, int index, uint64_t time, int amp);
+
+/**
+ * Adds an amplitude change to the synthesis buffer
+ *
+ * \param apu APU instance
+ * \param side 0 for the left output, 1 for the right one
+ * \param time Master clock value of the change
+ * \param delta Amplitude change
+ */
+static void apu_add_delta(gb_apu_t *apu, int side, uint64_t time, int delta);
+
+/**
+ * Takes finished samples from the synthesis buffers
+ *
+ * \param apu APU instance
+ * \param left Buffer for left samples, NULL to drop them
+ * \param right Buffer for right samples, NULL to drop them
+ * \param step Distance between samples in the buffers
+ * \param count Number of samples, must be available
+ */
+static void apu_take_samples(gb_apu_t *apu, int16_t *left, int16_t *right, int step, int count);
+
+/**
+ * Resamples synthesized sound to the output rate
+ *
+ * \param apu APU instance
+ * \param samples Buffer for interleaved stereo samples
+ * \param max_samples Buffer size in stereo samples
+ * \return Number of stereo samples written
+ */
+static int apu_resample(gb_apu_t *apu, int16_t *samples, int max_samples);
+
+/**
+ * Applies the resampler filter
+ *
+ * \param input Input samples, APU_RESAMPLER_TAPS of them are used
+ * \param filter Filter phase
+ * \return Output sample
+ */
+static inline int16_t apu_resampler_dot(const int16_t *input, const int16_t *filter);
+
+void apu_init(gb_apu_t *apu, struct gb *gb)
+{
+    assert(apu != NULL);
+    assert(gb  != NULL);
+
+    apu->gb = gb;
+
+    for (int i = 0; i < APU_REG_COUNT; i++)
+    {
+        apu->io_ports[i].apu  = apu;
+        apu->io_ports[i].addr = 0xFF10 + i;
+
+        mmu_register_io(&gb->mmu, 0xFF10 + i, apu_io_read, apu_io_write, &apu->io_ports[i]);
+    }
+
+    apu->mode        = APU_MODE_FULL;
+    apu->sample_rate = APU_DEFAULT_SAMPLE_RATE;
+
+    apu_reset(apu);
+}
+
+void apu_reset(gb_apu_t *apu)
+{
+    assert(apu != NULL);
+
+    // Channels are silent, mixer is set up as after the bootrom
+    memset(apu->regs, 0, REG_WAVE);
+    apu->regs[REG_NR50] = 0x77;
+    apu->regs[REG_NR51] = 0xF3;
+    apu->regs[REG_NR52] = 0x80;
+
+    memset(apu->channels, 0, sizeof(apu->channels));
+
+    apu->frame_seq_step = 0;
+    apu->next_frame_seq = FRAME_SEQ_PERIOD;
+
+    // Master clock is reset together with the APU
+    apu->last_time = 0;
+    apu_schedule_sync(apu, 0);
+
+    apu_restart_output(apu);
+}
+
+uint8_t apu_reg_read(gb_apu_t *apu, uint16_t addr)
+{
+    assert(apu != NULL);
+    assert(addr >= 0xFF10 && addr < 0xFF10 + APU_REG_COUNT);
+
+    int offset = addr - 0xFF10;
+
+    if (offset >= REG_WAVE)
+        return apu->regs[offset];
+
+    // 0xFF27-0xFF2F are unused
+    if (offset > REG_NR52)
+        return 0xFF;
+
+    if (offset == REG_NR52)
+    {
+        // Channel status depends on length counters
+        apu_sync(apu);
+
+        uint8_t value = apu->regs[REG_NR52] | apu_read_masks[REG_NR52];
+        for (int i = 0; i < 4; i++)
+            value |= apu->channels[i].enabled << i;
+
+        return value;
+    }
+
+    return apu->regs[offset] | apu_read_masks[offset];
+}
+
+void apu_reg_write(gb_apu_t *apu, uint16_t addr, uint8_t value)
+{
+    assert(apu != NULL);
+    assert(addr >= 0xFF10 && addr < 0xFF10 + APU_REG_COUNT);
+
+    int offset = addr - 0xFF10;
+    uint64_t now = apu->gb->scheduler.now;
+
+    apu_sync(apu);
+
+    if (offset >= REG_WAVE)
+    {
+        apu->regs[offset] = value;
+        return;
+    }
+
+    // 0xFF27-0xFF2F are unused, there is no channel behind them
+    if (offset > REG_NR52)
+        return;
+
+    bool powered = GET_BIT(apu->regs[REG_NR52], NR52_POWER_BIT);
+
+    if (offset == REG_NR52)
+    {
+        if (powered && !GET_BIT(value, NR52_POWER_BIT))
+        {
+            // Powering off clears all registers except the wave RAM
+            memset(apu->regs, 0, REG_WAVE);
+
+            for (int i = 0; i < 4; i++)
+            {
+                apu->channels[i].enabled     = false;
+                apu->channels[i].dac_enabled = false;
+                apu_channel_set_amp(apu, i, now, 0);
+            }
+        }
+        else if (!powered && GET_BIT(value, NR52_POWER_BIT))
+        {
+            apu->frame_seq_step = 0;
+            apu->next_frame_seq = now + FRAME_SEQ_PERIOD;
+        }
+
+        apu->regs[REG_NR52] = value & 0x80;
+        return;
+    }
+
+    if (!powered)
+        return;
+
+    apu->regs[offset] = value;
+
+    if (offset == REG_NR50 || offset == REG_NR51)
+    {
+        // Panning and master volume change outputs of all channels
+        for (int i = 0; i < 4; i++)
+            apu_channel_set_amp(apu, i, now, apu->channels[i].amp);
+
+        return;
+    }
+
+    int index = offset / 5;
+    apu_channel_t *channel = &apu->channels[index];
+
+    switch (offset % 5)
+    {
+    case 0:
+        if (offset == REG_NR30)
+        {
+            channel->dac_enabled = GET_BIT(value, 7);
+            if (!channel->dac_enabled)
+                channel->enabled = false;
+        }
+        break;
+
+    case 1:
+        // Length counter counts up to 64 (256 for the wave channel)
+        if (index == CHANNEL_WAVE)
+            channel->length = 256 - value;
+        else
+            channel->length = 64 - (value & 0x3F);
+        break;
+
+    case 2:
+        if (index != CHANNEL_WAVE)
+        {
+            // Envelope with initial volume 0 decreasing turns the DAC off
+            channel->dac_enabled = (value & 0xF8) != 0;
+            if (!channel->dac_enabled)
+                channel->enabled = false;
+        }
+        break;
+
+    case 4:
+        if (GET_BIT(value, 7))
+            apu_trigger(apu, index, now);
+        break;
+    }
+
+    apu_channel_set_amp(apu, index, now, apu_channel_amp(apu, index));
+}
+
+void apu_set_mode(gb_apu_t *apu, apu_mode_e mode, int sample_rate)
+{
+    assert(apu != NULL);
+    assert(sample_rate > 0);
+
+    apu_sync(apu);
+
+    if (apu->mode == APU_MODE_OFF)
+    {
+        // Waveforms weren't run while sound was off
+        for (int i = 0; i < 4; i++)
+            apu->channels[i].next_step = apu->last_time + apu_channel_period(apu, i);
+    }
+
+    apu->mode        = mode;
+    apu->sample_rate = sample_rate;
+
+    apu_restart_output(apu);
+
+    apu_schedule_sync(apu, apu->gb->scheduler.now);
+    scheduler_reschedule(&apu->gb->scheduler);
+}
+
+void apu_update(gb_apu_t *apu)
+{
+    assert(apu != NULL);
+
+    if (apu->gb->scheduler.now >= apu->next_sync_time)
+        apu_sync(apu);
+}
+
+int apu_read_samples(gb_apu_t *apu, int16_t *samples, int max_samples)
+{
+    assert(apu     != NULL);
+    assert(samples != NULL);
+
+    apu_sync(apu);
+
+    if (apu->mode == APU_MODE_OFF)
+        return 0;
+
+    if (apu->synth_rate != apu->sample_rate)
+        return apu_resample(apu, samples, max_samples);
+
+    int count = apu->sample_offset >> 32;
+    if (count > max_samples)
+        count = max_samples;
+
+    apu_take_samples(apu, &samples[0], &samples[1], 2, count);
+    return count;
+}
+
+static void apu_restart_output(gb_apu_t *apu)
+{
+    apu->synth_rate = apu->sample_rate;
+    if (apu->mode == APU_MODE_LOW && apu->sample_rate > APU_LOW_RATE)
+        apu->synth_rate = APU_LOW_RATE;
+
+    apu->sample_factor  = ((uint64_t)apu->synth_rate << 32) / CLOCK_RATE;
+    apu->resampler_step = ((uint64_t)apu->synth_rate << 32) / apu->sample_rate;
+
+    // Waveforms above 3/8 of the synthesis rate (~16 kHz at 44.1 kHz) are replaced by their average
+    apu->square_min_period = CLOCK_RATE / (3 * apu->synth_rate);
+    apu->wave_min_period   = CLOCK_RATE / (12 * apu->synth_rate);
+    apu->noise_min_period  = CLOCK_RATE / apu->synth_rate;
+
+    memset(apu->buffers, 0, sizeof(apu->buffers));
+    apu->sample_offset = 0;
+
+    apu->resampler_size = 0;
+    apu->resampler_pos  = 0;
+
+    // Channel outputs are added to the empty buffers again
+    for (int i = 0; i < 4; i++)
+    {
+        apu->channels[i].output[0] = 0;
+        apu->channels[i].output[1] = 0;
+
+        apu_channel_set_amp(apu, i, apu->last_time, apu_channel_amp(apu, i));
+    }
+}
+
+static uint8_t apu_io_read(void *device)
+{
+    gb_apu_io_port_t *port = device;
+    return apu_reg_read(port->apu, port->addr);
+}
+
+static void apu_io_write(void *device, uint8_t value)
+{
+    gb_apu_io_port_t *port = device;
+    apu_reg_write(port->apu, port->addr, value);
+}
+
+static void apu_sync(gb_apu_t *apu)
+{
+    uint64_t now = apu->gb->scheduler.now;
+
+    apu_schedule_sync(apu, now);
+
+    if (now <= apu->last_time)
+        return;
+
+    while (apu->next_frame_seq <= now)
+    {
+        apu_run_channels(apu, apu->next_frame_seq);
+        apu_frame_seq_tick(apu, apu->next_frame_seq);
+
+        apu->next_frame_seq += FRAME_SEQ_PERIOD;
+    }
+
+    apu_run_channels(apu, now);
+
+    if (apu->mode == APU_MODE_OFF)
+    {
+        apu->last_time = now;
+        return;
+    }
+
+    // Everything before now is final
+    apu->sample_offset += (now - apu->last_time) * apu->sample_factor;
+    apu->last_time = now;
+
+    // Nobody reads the samples, drop the oldest ones
+    int available = apu->sample_offset >> 32;
+    if (available > APU_BUFFER_SIZE / 2)
+        apu_take_samples(apu, NULL, NULL, 0, available - APU_BUFFER_SIZE / 2);
+}
+
+static void apu_schedule_sync(gb_apu_t *apu, uint64_t now)
+{
+    // Registers and channel status are brought up to date when accessed
+    if (apu->mode == APU_MODE_OFF)
+        apu->next_sync_time = SCHED_NEVER;
+    else
+        apu->next_sync_time = now + APU_SYNC_PERIOD;
+}
+
+static void apu_run_channels(gb_apu_t *apu, uint64_t end)
+{
+    // Waveforms don't affect the registers
+    if (apu->mode == APU_MODE_OFF)
+        return;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (apu->channels[i].enabled && apu->channels[i].dac_enabled)
+            apu_run_channel(apu, i, end);
+    }
+}
+
+static void apu_run_channel(gb_apu_t *apu, int index, uint64_t end)
+{
+    apu_channel_t *channel = &apu->channels[index];
+
+    int period = apu_channel_period(apu, index);
+    if (period == 0)
+    {
+        // Noise is not clocked, the next step is counted from here
+        channel->next_step = end;
+        return;
+    }
+
+    if (channel->next_step > end)
+        return;
+
+    if ((index <= CHANNEL_SQUARE2 && period < apu->square_min_period) ||
+        (index == CHANNEL_WAVE && period < apu->wave_min_period))
+    {
+        // Inaudible waveform, only its average is heard
+        uint64_t steps = (end - channel->next_step) / period + 1;
+
+        channel->next_step += steps * period;
+
+        int amp = 0;
+        if (index == CHANNEL_WAVE)
+        {
+            channel->phase = (channel->phase + steps) % 32;
+
+            int sum = 0;
+            for (int i = 0; i < 16; i++)
+                sum += (apu->regs[REG_WAVE + i] >> 4) + (apu->regs[REG_WAVE + i] & 0xF);
+
+            amp = (sum / 32) >> apu_wave_shifts[(apu->regs[REG_NR32] >> 5) & 0x3];
+        }
+        else
+        {
+            channel->phase = (channel->phase + steps) % 8;
+
+            int duty = apu->regs[CHANNEL_REGS(index) + 1] >> 6;
+            amp = channel->volume * apu_duty_lengths[duty] / 8;
+        }
+
+        apu_channel_set_amp(apu, index, apu->last_time, amp);
+        return;
+    }
+
+    if (index == CHANNEL_NOISE && period < apu->noise_min_period)
+    {
+        apu_run_fast_noise(apu, period, end);
+        return;
+    }
+
+    while (channel->next_step <= end)
+    {
+        switch (index)
+        {
+        case CHANNEL_SQUARE1:
+        case CHANNEL_SQUARE2:
+            channel->phase = (channel->phase + 1) % 8;
+            break;
+
+        case CHANNEL_WAVE:
+            channel->phase = (channel->phase + 1) % 32;
+            break;
+
+        case CHANNEL_NOISE:
+            apu_noise_step(apu);
+            break;
+        }
+
+        apu_channel_set_amp(apu, index, channel->next_step, apu_channel_amp(apu, index));
+        channel->next_step += period;
+    }
+}
+
+static void apu_run_fast_noise(gb_apu_t *apu, int period, uint64_t end)
+{
+    apu_channel_t *channel = &apu->channels[CHANNEL_NOISE];
+
+    // Register state is exact, only the output is averaged
+    int batch_steps = apu->noise_min_period / period;
+
+    while (channel->next_step <= end)
+    {
+        int steps = batch_steps;
+        if ((end - channel->next_step) / period + 1 < (uint64_t)steps)
+            steps = (end - channel->next_step) / period + 1;
+
+        uint64_t batch_start = channel->next_step;
+
+        int high_steps = 0;
+        for (int i = 0; i < steps; i++)
+        {
+            apu_noise_step(apu);
+            high_steps += ~channel->lfsr & 0x1;
+        }
+
+        channel->next_step += (uint64_t)steps * period;
+
+        int amp = (channel->volume * high_steps + steps / 2) / steps;
+        apu_channel_set_amp(apu, CHANNEL_NOISE, batch_start, amp);
+    }
+}
+
+static inline void apu_noise_step(gb_apu_t *apu)
+{
+    apu_channel_t *channel = &apu->channels[CHANNEL_NOISE];
+
+    int feedback = (channel->lfsr ^ (channel->lfsr >> 1)) & 0x1;
+    channel->lfsr = (channel->lfsr >> 1) | (feedback << 14);
+
+    // 7-bit mode
+    if (GET_BIT(apu->regs[REG_NR43], 3))
+        channel->lfsr = (channel->lfsr & ~0x40) | (feedback << 6);
+}
+
+static void apu_frame_seq_tick(gb_apu_t *apu, uint64_t time)
+{
+    int step = apu->frame_seq_step;
+    apu->frame_seq_step = (step + 1) % 8;
+
+    if (step % 2 == 0)
+    {
+        // Length counters, 256 Hz
+        for (int i = 0; i < 4; i++)
+        {
+            apu_channel_t *channel = &apu->channels[i];
+
+            if (GET_BIT(apu->regs[CHANNEL_REGS(i) + 4], 6) && channel->length > 0)
+            {
+                channel->length--;
+                if (channel->length == 0)
+                    channel->enabled = false;
+            }
+        }
+    }
+
+    if (step == 2 || step == 6)
+    {
+        // Frequency sweep, 128 Hz
+        apu_channel_t *channel = &apu->channels[CHANNEL_SQUARE1];
+        int sweep_period = (apu->regs[REG_NR10] >> 4) & 0x7;
+
+        if (--channel->sweep_timer <= 0)
+        {
+            channel->sweep_timer = sweep_period != 0 ? sweep_period : 8;
+
+            if (channel->sweep_enabled && sweep_period != 0)
+            {
+                int freq = apu_sweep_next(apu);
+                if (freq <= 0x7FF && (apu->regs[REG_NR10] & 0x7) != 0)
+                {
+                    channel->sweep_freq = freq;
+                    apu->regs[CHANNEL_REGS(0) + 3] = freq & 0xFF;
+                    apu->regs[CHANNEL_REGS(0) + 4] = (apu->regs[CHANNEL_REGS(0) + 4] & ~0x7) | (freq >> 8);
+
+                    // Overflow is checked once more with the new frequency
+                    apu_sweep_next(apu);
+                }
+            }
+        }
+    }
+
+    if (step == 7)
+    {
+        // Volume envelopes, 64 Hz
+        for (int i = 0; i < 4; i++)
+        {
+            if (i == CHANNEL_WAVE)
+                continue;
+
+            apu_channel_t *channel = &apu->channels[i];
+            uint8_t envelope = apu->regs[CHANNEL_REGS(i) + 2];
+
+            if ((envelope & 0x7) == 0 || --channel->envelope_timer > 0)
+                continue;
+
+            channel->envelope_timer = envelope & 0x7;
+
+            if (GET_BIT(envelope, 3) && channel->volume < 15)
+                channel->volume++;
+            else if (!GET_BIT(envelope, 3) && channel->volume > 0)
+                channel->volume--;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+        apu_channel_set_amp(apu, i, time, apu_channel_amp(apu, i));
+}
+
+static void apu_trigger(gb_apu_t *apu, int index, uint64_t time)
+{
+    apu_channel_t *channel = &apu->channels[index];
+    uint8_t envelope = apu->regs[CHANNEL_REGS(index) + 2];
+
+    channel->enabled = channel->dac_enabled;
+
+    if (channel->length == 0)
+        channel->length = index == CHANNEL_WAVE ? 256 : 64;
+
+    channel->volume         = envelope >> 4;
+    channel->envelope_timer = envelope & 0x7;
+
+    switch (index)
+    {
+    case CHANNEL_SQUARE1:
+    {
+        int sweep_period = (apu->regs[REG_NR10] >> 4) & 0x7;
+        int sweep_shift  = apu->regs[REG_NR10] & 0x7;
+
+        channel->sweep_freq    = apu->regs[CHANNEL_REGS(0) + 3] | ((apu->regs[CHANNEL_REGS(0) + 4] & 0x7) << 8);
+        channel->sweep_timer   = sweep_period != 0 ? sweep_period : 8;
+        channel->sweep_enabled = sweep_period != 0 || sweep_shift != 0;
+
+        if (sweep_shift != 0)
+            apu_sweep_next(apu);
+        break;
+    }
+
+    case CHANNEL_WAVE:
+        channel->phase = 0;
+        break;
+
+    case CHANNEL_NOISE:
+        channel->lfsr = 0x7FFF;
+        break;
+    }
+
+    channel->next_step = time + apu_channel_period(apu, index);
+}
+
+static int apu_sweep_next(gb_apu_t *apu)
+{
+    apu_channel_t *channel = &apu->channels[CHANNEL_SQUARE1];
+
+    int delta = channel->sweep_freq >> (apu->regs[REG_NR10] & 0x7);
+    int freq  = GET_BIT(apu->regs[REG_NR10], 3) ? channel->sweep_freq - delta : channel->sweep_freq + delta;
+
+    if (freq > 0x7FF)
+        channel->enabled = false;
+
+    return freq;
+}
+
+static int apu_channel_period(gb_apu_t *apu, int index)
+{
+    const uint8_t *regs = &apu->regs[CHANNEL_REGS(index)];
+
+    if (index == CHANNEL_NOISE)
+    {
+        int shift = regs[3] >> 4;
+        if (shift >= 14)
+            return 0;
+
+        return apu_noise_divisors[regs[3] & 0x7] << shift;
+    }
+
+    int freq = regs[3] | ((regs[4] & 0x7) << 8);
+    return (2048 - freq) * (index == CHANNEL_WAVE ? 2 : 4);
+}
+
+static int apu_channel_amp(gb_apu_t *apu, int index)
+{
+    apu_channel_t *channel = &apu->channels[index];
+
+    if (!channel->enabled || !channel->dac_enabled)
+        return 0;
+
+    switch (index)
+    {
+    case CHANNEL_SQUARE1:
+    case CHANNEL_SQUARE2:
+    {
+        int duty = apu->regs[CHANNEL_REGS(index) + 1] >> 6;
+        return (apu_duty_patterns[duty] >> (7 - channel->phase)) & 0x1 ? channel->volume : 0;
+    }
+
+    case CHANNEL_WAVE:
+    {
+        // Upper nibble is played first
+        uint8_t samples = apu->regs[REG_WAVE + channel->phase / 2];
+        int sample = channel->phase % 2 == 0 ? samples >> 4 : samples & 0xF;
+
+        return sample >> apu_wave_shifts[(apu->regs[REG_NR32] >> 5) & 0x3];
+    }
+
+    default:
+        return channel->lfsr & 0x1 ? 0 : channel->volume;
+    }
+}
+
+static void apu_channel_set_amp(gb_apu_t *apu, int index, uint64_t time, int amp)
+{
+    apu_channel_t *channel = &apu->channels[index];
+    channel->amp = amp;
+
+    if (apu->mode == APU_MODE_OFF)
+        return;
+
+    uint8_t nr50 = apu->regs[REG_NR50];
+    uint8_t nr51 = apu->regs[REG_NR51];
+
+    // NR51 upper nibble and NR50 upper bits are the left side
+    int left  = GET_BIT(nr51, index + 4) ? amp * (((nr50 >> 4) & 0x7) + 1) : 0;
+    int right = GET_BIT(nr51, index)     ? amp * ((nr50 & 0x7) + 1)        : 0;
+
+    if (left != channel->output[0])
+    {
+        apu_add_delta(apu, 0, time, left - channel->output[0]);
+        channel->output[0] = left;
+    }
+
+    if (right != channel->output[1])
+    {
+        apu_add_delta(apu, 1, time, right - channel->output[1]);
+        channel->output[1] = right;
+    }
+}
+
+static void apu_add_delta(gb_apu_t *apu, int side, uint64_t time, int delta)
+{
+    uint64_t pos = apu->sample_offset + (time - apu->last_time) * apu->sample_factor;
+
+    int index = pos >> 32;
+    int phase = (pos >> (32 - 5)) & (KERNEL_PHASES - 1);
+
+    // Can't happen unless the APU isn't synced for a long time
+    if (index > APU_BUFFER_SIZE)
+        return;
+
+    int32_t *deltas = &apu->buffers[side].deltas[index];
+    const int16_t *kernel = apu_step_kernel[phase];
+
+    for (int i = 0; i < APU_KERNEL_WIDTH; i++)
+        deltas[i] += kernel[i] * delta;
+}
+
+static void apu_take_samples(gb_apu_t *apu, int16_t *left, int16_t *right, int step, int count)
+{
+    int used = (apu->sample_offset >> 32) + APU_KERNEL_WIDTH;
+
+    for (int side = 0; side < 2; side++)
+    {
+        apu_buffer_t *buffer = &apu->buffers[side];
+        int16_t *samples = side == 0 ? left : right;
+        int32_t sum = buffer->sum;
+
+        for (int i = 0; i < count; i++)
+        {
+            sum += buffer->deltas[i];
+
+            if (samples != NULL)
+            {
+                int sample = sum >> OUTPUT_SHIFT;
+                if (sample > INT16_MAX)
+                    sample = INT16_MAX;
+                else if (sample < INT16_MIN)
+                    sample = INT16_MIN;
+
+                samples[i * step] = sample;
+            }
+
+            sum -= sum >> HIGH_PASS_SHIFT;
+        }
+
+        buffer->sum = sum;
+
+        memmove(buffer->deltas, &buffer->deltas[count], (used - count) * sizeof(int32_t));
+        memset(&buffer->deltas[used - count], 0, count * sizeof(int32_t));
+    }
+
+    apu->sample_offset -= (uint64_t)count << 32;
+}
+
+static int apu_resample(gb_apu_t *apu, int16_t *samples, int max_samples)
+{
+    // Move synthesized samples to the resampler input
+    int count = apu->sample_offset >> 32;
+    int space = APU_BUFFER_SIZE + APU_RESAMPLER_TAPS - apu->resampler_size;
+    if (count > space)
+        count = space;
+
+    apu_take_samples(apu, &apu->resampler_input[0][apu->resampler_size],
+                          &apu->resampler_input[1][apu->resampler_size], 1, count);
+    apu->resampler_size += count;
+
+    int produced = 0;
+    while (produced < max_samples)
+    {
+        int pos   = apu->resampler_pos >> 32;
+        int phase = (apu->resampler_pos >> (32 - 5)) & (RESAMPLER_PHASES - 1);
+
+        if (pos + APU_RESAMPLER_TAPS > apu->resampler_size)
+            break;
+
+        const int16_t *filter = apu_resampler_filter[phase];
+        samples[produced * 2]     = apu_resampler_dot(&apu->resampler_input[0][pos], filter);
+        samples[produced * 2 + 1] = apu_resampler_dot(&apu->resampler_input[1][pos], filter);
+
+        apu->resampler_pos += apu->resampler_step;
+        produced++;
+    }
+
+    // Drop consumed input
+    int consumed = apu->resampler_pos >> 32;
+    if (consumed > apu->resampler_size)
+        consumed = apu->resampler_size;
+
+    for (int side = 0; side < 2; side++)
+    {
+        memmove(apu->resampler_input[side], &apu->resampler_input[side][consumed],
+                (apu->resampler_size - consumed) * sizeof(int16_t));
+    }
+
+    apu->resampler_size -= consumed;
+    apu->resampler_pos  -= (uint64_t)consumed << 32;
+
+    return produced;
+}
+
+static inline int16_t apu_resampler_dot(const int16_t *input, const int16_t *filter)
+{
+    int sum = 0;
+
+#ifdef APU_X86
+    // 8 products summed in pairs, then horizontally
+    __m128i products = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)input),
+                                      _mm_load_si128((const __m128i*)filter));
+
+    products = _mm_add_epi32(products, _mm_shuffle_epi32(products, _MM_SHUFFLE(1, 0, 3, 2)));
+    products = _mm_add_epi32(products, _mm_shuffle_epi32(products, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(products);
+#else
+    for (int i = 0; i < APU_RESAMPLER_TAPS; i++)
+        sum += input[i] * filter[i];
+#endif
+
+    sum >>= RESAMPLER_BITS;
+    if (sum > INT16_MAX)
+        sum = INT16_MAX;
+    else if (sum < INT16_MIN)
+        sum = INT16_MIN;
+
+    return sum;
+}
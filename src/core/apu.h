@@ -0,0 +1,232 @@
+#ifndef APU_H
+#define APU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gbstatus.h"
+
+/// Default output sample rate in Hz
+#define APU_DEFAULT_SAMPLE_RATE 44100
+
+/// Synthesis rate of the low-rate mode in Hz
+#define APU_LOW_RATE 16384
+
+/// Number of stereo samples buffered between reads, older ones are dropped
+#define APU_BUFFER_SIZE 4096
+
+/// Width of the band-limited step in samples
+#define APU_KERNEL_WIDTH 16
+
+/// Number of sound registers (0xFF10-0xFF3F)
+#define APU_REG_COUNT 0x30
+
+/// Length of the low-rate mode resampler filter in samples
+#define APU_RESAMPLER_TAPS 8
+
+/**
+ * Sound emulation modes
+ */
+typedef enum
+{
+    /// Only registers and channel status are emulated, no sound is produced
+    APU_MODE_OFF,
+
+    /// Sound is synthesized at APU_LOW_RATE and resampled to the output rate
+    APU_MODE_LOW,
+
+    /// Sound is synthesized at the output rate
+    APU_MODE_FULL
+} apu_mode_e;
+
+struct gb;
+struct gb_apu;
+
+/**
+ * Ties a sound register to the APU so all of them can share MMIO handlers
+ */
+typedef struct
+{
+    struct gb_apu *apu;
+    uint16_t addr;
+} gb_apu_io_port_t;
+
+/**
+ * State of one of the four sound channels.
+ * Fields which don't apply to the channel are unused.
+ */
+typedef struct
+{
+    /// Whether the channel is playing (NR52 status bit)
+    bool enabled;
+
+    /// Whether the channel DAC is powered
+    bool dac_enabled;
+
+    /// Length counter, the channel is stopped when it runs out
+    int length;
+
+    /// Current envelope volume (0-15)
+    int volume;
+
+    /// Frame sequencer ticks until the next envelope step
+    int envelope_timer;
+
+    /// Position in the duty cycle or wave RAM
+    int phase;
+
+    /// Master clock value of the next waveform step
+    uint64_t next_step;
+
+    /// Noise channel shift register
+    uint16_t lfsr;
+
+    /// Frequency sweep state (channel 1 only)
+    int  sweep_timer;
+    int  sweep_freq;
+    bool sweep_enabled;
+
+    /// Channel DAC input (0-15) produced at the synthesis time
+    int amp;
+
+    /// Contribution of the channel to the left and right outputs
+    int output[2];
+} apu_channel_t;
+
+/**
+ * Band-limited synthesis buffer of one output side.
+ *
+ * Amplitude changes are stored as deltas spread over a few samples by a band-limited step,
+ * so samples are produced at the synthesis rate directly without running the
+ * channels at the clock rate. Samples are integrated back when read.
+ */
+typedef struct
+{
+    int32_t deltas[APU_BUFFER_SIZE + APU_KERNEL_WIDTH];
+
+    /// Integrator state
+    int32_t sum;
+} apu_buffer_t;
+
+/**
+ * Gameboy APU representation.
+ *
+ * Sound is synthesized lazily - only when registers are accessed, when samples are read
+ * and periodically to keep the buffered time bounded. Channels are run from one
+ * waveform step to another, so nothing is done per clock cycle.
+ */
+typedef struct gb_apu
+{
+    /// Sound registers as written, including the wave RAM
+    uint8_t regs[APU_REG_COUNT];
+
+    apu_channel_t channels[4];
+
+    /// Frame sequencer step (0-7) and the master clock value of the next one
+    int frame_seq_step;
+    uint64_t next_frame_seq;
+
+    /// Master clock value sound is synthesized up to
+    uint64_t last_time;
+
+    /// Master clock value of the next periodic synthesis, SCHED_NEVER if sound is off
+    uint64_t next_sync_time;
+
+    /// Left and right synthesis buffers
+    apu_buffer_t buffers[2];
+
+    /// Sample position of last_time in 32.32 fixed point
+    uint64_t sample_offset;
+
+    /// Synthesized samples per clock cycle in 32.32 fixed point
+    uint64_t sample_factor;
+
+    apu_mode_e mode;
+
+    /// Output and synthesis sample rates in Hz
+    int sample_rate;
+    int synth_rate;
+
+    /// Waveform step periods below these are inaudible at the synthesis rate
+    int square_min_period;
+    int wave_min_period;
+
+    /// Noise steps shorter than this are averaged in batches of one synthesis sample
+    int noise_min_period;
+
+    /// Synthesized samples waiting for resampling (low-rate mode only)
+    int16_t resampler_input[2][APU_BUFFER_SIZE + APU_RESAMPLER_TAPS];
+    int resampler_size;
+
+    /// Position of the next output sample in the resampler input in 32.32 fixed point
+    uint64_t resampler_pos;
+
+    /// Input samples per output sample in 32.32 fixed point
+    uint64_t resampler_step;
+
+    gb_apu_io_port_t io_ports[APU_REG_COUNT];
+
+    /// Pointer to the parent Gameboy structure
+    struct gb *gb;
+} gb_apu_t;
+
+/**
+ * Initializes the instance of the APU
+ *
+ * \param apu APU instance
+ * \param gb Parent GB instance
+ */
+void apu_init(gb_apu_t *apu, struct gb *gb);
+
+/**
+ * Resets the APU
+ *
+ * \param apu APU instance
+ */
+void apu_reset(gb_apu_t *apu);
+
+/**
+ * Emulates sound register reading
+ *
+ * \param apu APU instance
+ * \param addr Register address
+ * \return Register value
+ */
+uint8_t apu_reg_read(gb_apu_t *apu, uint16_t addr);
+
+/**
+ * Emulates writing to a sound register
+ *
+ * \param apu APU instance
+ * \param addr Register address
+ * \param value Value to write
+ */
+void apu_reg_write(gb_apu_t *apu, uint16_t addr, uint8_t value);
+
+/**
+ * Changes the sound emulation mode and the output sample rate.
+ * Buffered sound is dropped
+ *
+ * \param apu APU instance
+ * \param mode Emulation mode
+ * \param sample_rate Output sample rate in Hz
+ */
+void apu_set_mode(gb_apu_t *apu, apu_mode_e mode, int sample_rate);
+
+/**
+ * Synthesizes sound if the periodic synthesis is due
+ *
+ * \param apu APU instance
+ */
+void apu_update(gb_apu_t *apu);
+
+/**
+ * Synthesizes sound up to the current time and takes the produced samples
+ *
+ * \param apu APU instance
+ * \param samples Buffer for interleaved stereo samples
+ * \param max_samples Buffer size in stereo samples
+ * \return Number of stereo samples written, always 0 if sound is off
+ */
+int apu_read_samples(gb_apu_t *apu, int16_t *samples, int max_samples);
+
+#endif
@@ -0,0 +1,283 @@
+#include <string.h>
+#include <assert.h>
+#include "block_cache.h"
+#include "cart.h"
+#include "gb.h"
+
+/// Instruction lengths in bytes (opcode included)
+static const uint8_t instr_lengths[256] =
+{
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, // 0x00
+    1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x10
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x20
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x30
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xA0
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xB0
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // 0xC0
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, // 0xD0
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, // 0xE0
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1  // 0xF0
+};
+
+/**
+ * Checks whether the instruction unconditionally leaves straight-line flow
+ *
+ * \param opcode Instruction opcode
+ */
+static bool block_cache_ends_block(uint8_t opcode);
+
+/**
+ * Determines whether code at the given address can be cached
+ *
+ * \param cache Block cache instance
+ * \param addr Instruction address
+ * \param region_end Receives the end of the memory region containing the address
+ * \param rom_bank Receives the ROM bank the address is mapped to
+ * \return True if the address can be cached
+ */
+static bool block_cache_region(gb_block_cache_t *cache, uint16_t addr, uint32_t *region_end, int *rom_bank);
+
+/**
+ * Decodes the block starting at the given address into the slot
+ *
+ * \param cache Block cache instance
+ * \param block Block slot
+ * \param addr Block start address
+ * \param region_end End of the memory region containing the block
+ * \param rom_bank ROM bank the block is mapped to
+ */
+static void block_cache_decode(gb_block_cache_t *cache, gb_block_t *block, uint16_t addr,
+                               uint32_t region_end, int rom_bank);
+
+gbstatus_e block_cache_init(gb_block_cache_t *cache, gb_t *gb)
+{
+    gbstatus_e status = GBSTATUS_OK;
+
+    assert(cache != NULL);
+    assert(gb    != NULL);
+
+    cache->gb = gb;
+
+    cache->blocks = calloc(BLOCK_CACHE_SIZE, sizeof(gb_block_t));
+    if (cache->blocks == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        return status;
+    }
+
+    block_cache_reset(cache);
+    return GBSTATUS_OK;
+}
+
+void block_cache_reset(gb_block_cache_t *cache)
+{
+    assert(cache != NULL);
+
+    for (int i = 0; i < BLOCK_CACHE_SIZE; i++)
+        cache->blocks[i].valid = false;
+
+    cache->curr_block = NULL;
+    cache->next_instr = 0;
+    cache->ram_gen    = 0;
+
+    memset(cache->ram_code_lines, 0, sizeof(cache->ram_code_lines));
+}
+
+const gb_decoded_instr_t *block_cache_lookup(gb_block_cache_t *cache, uint16_t addr)
+{
+    assert(cache != NULL);
+
+    cache->curr_block = NULL;
+
+    uint32_t region_end = 0;
+    int rom_bank = 0;
+
+    if (!block_cache_region(cache, addr, &region_end, &rom_bank))
+        return NULL;
+
+    gb_block_t *block = &cache->blocks[(addr ^ (rom_bank << 6)) & (BLOCK_CACHE_SIZE - 1)];
+
+    bool hit = block->valid && block->start_addr == addr && block->rom_bank == rom_bank;
+    if (hit && addr >= 0xC000)
+        hit = block->ram_gen == cache->ram_gen;
+
+    if (!hit)
+    {
+        block_cache_decode(cache, block, addr, region_end, rom_bank);
+        if (!block->valid)
+            return NULL;
+    }
+
+    cache->curr_block = block;
+    cache->next_instr = 1;
+    return &block->instrs[0];
+}
+
+void block_cache_invalidate_ram(gb_block_cache_t *cache)
+{
+    assert(cache != NULL);
+
+    // All RAM blocks become stale at once, they are rare enough
+    cache->ram_gen++;
+    cache->curr_block = NULL;
+
+    memset(cache->ram_code_lines, 0, sizeof(cache->ram_code_lines));
+    mmu_update_ram_map(&cache->gb->mmu);
+}
+
+void block_cache_deinit(gb_block_cache_t *cache)
+{
+    assert(cache != NULL);
+
+    free(cache->blocks);
+}
+
+static bool block_cache_ends_block(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x18: // jr
+    case 0xC3: // jp
+    case 0xE9: // jp hl
+    case 0xCD: // call
+    case 0xC9: // ret
+    case 0xD9: // reti
+    case 0xC7: // rst
+    case 0xCF:
+    case 0xD7:
+    case 0xDF:
+    case 0xE7:
+    case 0xEF:
+    case 0xF7:
+    case 0xFF:
+    case 0x76: // halt
+    case 0x10: // stop
+    case 0xD3: // illegal
+    case 0xE3:
+    case 0xE4:
+    case 0xF4:
+    case 0xDB:
+    case 0xEB:
+    case 0xEC:
+    case 0xFC:
+    case 0xDD:
+    case 0xED:
+    case 0xFD:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static bool block_cache_region(gb_block_cache_t *cache, uint16_t addr, uint32_t *region_end, int *rom_bank)
+{
+    gb_mmu_t *mmu = &cache->gb->mmu;
+
+    switch (addr & 0xF000)
+    {
+    case 0x0000:
+    case 0x1000:
+    case 0x2000:
+    case 0x3000:
+        // The bootrom is executed once, don't bother
+        if (mmu->cart == NULL || (addr < 0x100 && mmu->bootrom_mapped))
+            return false;
+
+        *region_end = 0x4000;
+        *rom_bank   = 0;
+        return true;
+
+    case 0x4000:
+    case 0x5000:
+    case 0x6000:
+    case 0x7000:
+        if (mmu->cart == NULL)
+            return false;
+
+        *region_end = 0x8000;
+        *rom_bank   = mmu->cart->curr_rom_bank;
+        return true;
+
+    case 0xC000:
+    case 0xD000:
+        // WRAM
+        *region_end = 0xE000;
+        *rom_bank   = 0;
+        return true;
+
+    case 0xF000:
+        if (addr < 0xFF80 || addr == 0xFFFF)
+            return false;
+
+        // HRAM
+        *region_end = 0xFFFF;
+        *rom_bank   = 0;
+        return true;
+
+    default:
+        // VRAM, cartridge RAM and MMIO might change under our feet
+        return false;
+    }
+}
+
+static void block_cache_decode(gb_block_cache_t *cache, gb_block_t *block, uint16_t addr,
+                               uint32_t region_end, int rom_bank)
+{
+    gb_mmu_t *mmu = &cache->gb->mmu;
+
+    bool in_ram = addr >= 0xC000;
+    uint32_t pc = addr;
+
+    block->instr_count = 0;
+
+    while (block->instr_count < BLOCK_MAX_INSTRS)
+    {
+        // Regions handled here have no read side effects
+        uint8_t opcode = mmu_read(mmu, pc);
+        int length = instr_lengths[opcode];
+
+        // Instruction crosses the region boundary
+        if (pc + length > region_end)
+            break;
+
+        gb_decoded_instr_t *instr = &block->instrs[block->instr_count];
+        instr->addr    = pc;
+        instr->opcode  = opcode;
+        instr->operand = 0;
+
+        if (length > 1)
+            instr->operand |= mmu_read(mmu, pc + 1);
+        if (length > 2)
+            instr->operand |= mmu_read(mmu, pc + 2) << 8;
+
+        if (in_ram)
+        {
+            uint32_t offset = pc >= 0xFF80 ? pc - 0xFF80 + 0x2000 : pc - 0xC000;
+
+            cache->ram_code_lines[offset / BLOCK_RAM_LINE_SIZE] = 1;
+            cache->ram_code_lines[(offset + length - 1) / BLOCK_RAM_LINE_SIZE] = 1;
+        }
+
+        block->instr_count++;
+        pc += length;
+
+        if (block_cache_ends_block(opcode))
+            break;
+    }
+
+    // Writes to the decoded code must not bypass block_cache_ram_write
+    if (in_ram && addr < 0xE000)
+        mmu_update_ram_map(mmu);
+
+    block->valid      = block->instr_count > 0;
+    block->start_addr = addr;
+    block->rom_bank   = rom_bank;
+    block->ram_gen    = cache->ram_gen;
+}
@@ -0,0 +1,167 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gbstatus.h"
+
+struct gb;
+
+/// Number of block slots, must be a power of two
+#define BLOCK_CACHE_SIZE 1024
+
+/// Maximum number of instructions in one block
+#define BLOCK_MAX_INSTRS 32
+
+/// Granularity of RAM code tracking in bytes
+#define BLOCK_RAM_LINE_SIZE 64
+
+/// WRAM and HRAM are tracked as one contiguous area
+#define BLOCK_RAM_LINES ((0x2000 + 0x80) / BLOCK_RAM_LINE_SIZE + 1)
+
+/**
+ * Pre-decoded instruction
+ */
+typedef struct gb_decoded_instr
+{
+    /// Instruction address
+    uint16_t addr;
+
+    uint8_t opcode;
+
+    /// Bytes following the opcode (little-endian immediate or CB opcode)
+    uint16_t operand;
+} gb_decoded_instr_t;
+
+/**
+ * Straight-line run of decoded instructions.
+ * Execution may leave it at any conditional branch.
+ */
+typedef struct gb_block
+{
+    bool valid;
+
+    /// Address of the first instruction
+    uint16_t start_addr;
+
+    /// ROM bank the block was decoded from
+    int rom_bank;
+
+    /// RAM generation the block was decoded at (RAM blocks only)
+    unsigned ram_gen;
+
+    int instr_count;
+
+    gb_decoded_instr_t instrs[BLOCK_MAX_INSTRS];
+} gb_block_t;
+
+/**
+ * Decoded block cache for the CPU.
+ * Blocks are keyed by (PC, ROM bank), so bank switches never make a cached block stale,
+ * they only force the CPU to look the current block up again.
+ * Code in WRAM/HRAM is cached too and dropped when its memory is written.
+ */
+typedef struct gb_block_cache
+{
+    /// Direct-mapped block slots
+    gb_block_t *blocks;
+
+    /// Block being executed (NULL if the last instruction wasn't cached)
+    gb_block_t *curr_block;
+
+    /// Index of the next instruction in the current block
+    int next_instr;
+
+    /// Bumped on writes to RAM lines containing cached code
+    unsigned ram_gen;
+
+    /// Nonzero for RAM lines which have cached code
+    uint8_t ram_code_lines[BLOCK_RAM_LINES];
+
+    /// Pointer to the parent Gameboy structure
+    struct gb *gb;
+} gb_block_cache_t;
+
+/**
+ * Initializes the instance of the block cache
+ *
+ * \param cache Block cache instance
+ * \param gb Parent GB instance
+ */
+gbstatus_e block_cache_init(gb_block_cache_t *cache, struct gb *gb);
+
+/**
+ * Drops all cached blocks
+ *
+ * \param cache Block cache instance
+ */
+void block_cache_reset(gb_block_cache_t *cache);
+
+/**
+ * Finds or decodes the block starting at the given address
+ *
+ * \param cache Block cache instance
+ * \param addr Instruction address
+ * \return Decoded instruction or NULL if the address can't be cached
+ */
+const gb_decoded_instr_t *block_cache_lookup(gb_block_cache_t *cache, uint16_t addr);
+
+/**
+ * Invalidates cached RAM code after a write to it
+ *
+ * \param cache Block cache instance
+ */
+void block_cache_invalidate_ram(gb_block_cache_t *cache);
+
+/**
+ * Deinitializes the instance of the block cache
+ *
+ * \param cache Block cache instance
+ */
+void block_cache_deinit(gb_block_cache_t *cache);
+
+/**
+ * Returns the decoded instruction at the given address
+ *
+ * \param cache Block cache instance
+ * \param addr Instruction address
+ * \return Decoded instruction or NULL if the address can't be cached
+ */
+static inline const gb_decoded_instr_t *block_cache_fetch(gb_block_cache_t *cache, uint16_t addr)
+{
+    gb_block_t *block = cache->curr_block;
+
+    // Fast path: execution continues within the current block
+    if (block != NULL && cache->next_instr < block->instr_count &&
+        block->instrs[cache->next_instr].addr == addr)
+        return &block->instrs[cache->next_instr++];
+
+    return block_cache_lookup(cache, addr);
+}
+
+/**
+ * Must be called when the cartridge ROM mapping changes
+ *
+ * \param cache Block cache instance
+ */
+static inline void block_cache_map_changed(gb_block_cache_t *cache)
+{
+    // Blocks are keyed by bank, only the running one has to be looked up again
+    cache->curr_block = NULL;
+}
+
+/**
+ * Must be called on every write to WRAM (0xC000-0xDFFF) or HRAM (0xFF80-0xFFFE)
+ *
+ * \param cache Block cache instance
+ * \param addr Address written to
+ */
+static inline void block_cache_ram_write(gb_block_cache_t *cache, uint16_t addr)
+{
+    int line = (addr >= 0xFF80 ? addr - 0xFF80 + 0x2000 : addr - 0xC000) / BLOCK_RAM_LINE_SIZE;
+
+    if (cache->ram_code_lines[line])
+        block_cache_invalidate_ram(cache);
+}
+
+#endif
@@ -8,11 +8,29 @@
 #include "mbc2.h"
 #include "mbc5.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define CART_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #define GAME_TITLE_ADDR 0x134
 #define CART_TYPE_ADDR  0x147
 #define ROM_SIZE_ADDR   0x148
 #define RAM_SIZE_ADDR   0x149
 
+/// Largest ROM size header value, 8MB
+#define MAX_ROM_SIZE_CODE 0x08
+
+static gbstatus_e cart_load_rom(gb_cart_t *cart, const char *rom_path);
+static gbstatus_e cart_read_rom(gb_cart_t *cart, FILE *rom_file);
+static gbstatus_e cart_check_rom_size(gb_cart_t *cart, size_t rom_file_size);
+static void cart_unload_rom(gb_cart_t *cart);
+
+#ifdef CART_MMAP
+static gbstatus_e cart_map_rom(gb_cart_t *cart, FILE *rom_file, size_t rom_file_size);
+#endif
+
 static gbstatus_e cart_load_sram(gb_cart_t *cart);
 static gbstatus_e cart_save_sram(gb_cart_t *cart);
 
@@ -23,61 +41,9 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
     assert(cart != NULL);
     assert(rom_path != NULL);
 
-    FILE *rom_file = fopen(rom_path, "rb");
-    if (rom_file == NULL)
-    {
-        GBSTATUS(GBSTATUS_IO_FAIL, "unable to open ROM file: %s", strerror(errno));
+    status = cart_load_rom(cart, rom_path);
+    if (status != GBSTATUS_OK)
         goto error_handler0;
-    }
-
-    if (fseek(rom_file, 0, SEEK_END) != 0)
-    {
-        GBSTATUS(GBSTATUS_IO_FAIL, "failed to read ROM");
-        goto error_handler1;
-    }
-
-    int rom_file_size = 0;
-    if ((rom_file_size = ftell(rom_file)) == -1)
-    {
-        GBSTATUS(GBSTATUS_IO_FAIL, "failed to read ROM");
-        goto error_handler1;
-    }
-
-    if (fseek(rom_file, 0, SEEK_SET) != 0)
-    {
-        GBSTATUS(GBSTATUS_IO_FAIL, "failed to read ROM");
-        goto error_handler1;
-    }
-    
-    if (rom_file_size < ROM_BANK_SIZE * 2)
-    {
-        GBSTATUS(GBSTATUS_CART_FAIL, "ROM cannot be less than 32KB");
-        goto error_handler1;
-    }
-
-    cart->rom = calloc(rom_file_size, sizeof(uint8_t));
-    if (cart->rom == NULL)
-    {
-        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
-        goto error_handler1;
-    }
-
-    int bytes_read = fread(cart->rom, sizeof(uint8_t), rom_file_size, rom_file);
-    if (bytes_read != rom_file_size)
-    {
-        GBSTATUS(GBSTATUS_IO_FAIL, "failed to read ROM");
-        goto error_handler2;
-    }
-
-    int rom_size_header = (2 << cart->rom[ROM_SIZE_ADDR]) * ROM_BANK_SIZE;
-    
-    if (bytes_read != rom_size_header)
-    {
-        GBSTATUS(GBSTATUS_CART_FAIL, "ROM file size is different from header info");
-        goto error_handler2;
-    }
-
-    cart->rom_size = rom_size_header / ROM_BANK_SIZE;
 
     uint8_t ram_size_header = cart->rom[RAM_SIZE_ADDR];
     switch (ram_size_header)
@@ -104,11 +70,14 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
     if (cart->ram == NULL)
     {
         GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
-        goto error_handler2;
+        goto error_handler1;
     }
 
     cart->battery_backed = false;
 
+    cart->map_listener      = NULL;
+    cart->map_listener_data = NULL;
+
     uint8_t mapper = cart->rom[CART_TYPE_ADDR];
     switch (mapper)
     {
@@ -116,7 +85,7 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
         // No mapper
         status = mbc_none_init(cart);
         if (status != GBSTATUS_OK)
-            goto error_handler3;
+            goto error_handler2;
 
         cart->mbc_read_func   = mbc_none_read;
         cart->mbc_write_func  = mbc_none_write;
@@ -130,7 +99,7 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
         // MBC1(+RAM(+BATTERY))
         status = mbc1_init(cart);
         if (status != GBSTATUS_OK)
-            goto error_handler3;
+            goto error_handler2;
 
         cart->mbc_read_func   = mbc1_read;
         cart->mbc_write_func  = mbc1_write;
@@ -147,7 +116,7 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
         // MBC2(+BATTERY)
         status = mbc2_init(cart);
         if (status != GBSTATUS_OK)
-            goto error_handler3;
+            goto error_handler2;
 
         cart->mbc_read_func   = mbc2_read;
         cart->mbc_write_func  = mbc2_write;
@@ -168,7 +137,7 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
         // MBC5(+RUMBLE(+RAM(+BATTERY)))
         status = mbc5_init(cart);
         if (status != GBSTATUS_OK)
-            goto error_handler3;
+            goto error_handler2;
 
         cart->mbc_read_func   = mbc5_read;
         cart->mbc_write_func  = mbc5_write;
@@ -182,14 +151,14 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
 
     default:
         GBSTATUS(GBSTATUS_NOT_IMPLEMENTED, "unsupported mapper");
-        goto error_handler3;
+        goto error_handler2;
 
         break;
     }
 
     strncpy(cart->rom_file_path, rom_path, MAX_ROM_PATH_LEN);
 
-    strncpy(cart->game_title, (char*)&cart->rom[GAME_TITLE_ADDR], GAME_TITLE_LEN);
+    strncpy(cart->game_title, (const char*)&cart->rom[GAME_TITLE_ADDR], GAME_TITLE_LEN);
     cart->game_title[GAME_TITLE_LEN] = '\0';
 
     if (cart->battery_backed)
@@ -203,17 +172,13 @@ gbstatus_e cart_init(gb_cart_t *cart, const char *rom_path)
         }
     }
 
-    fclose(rom_file);
     return GBSTATUS_OK;
 
-error_handler3:
-    free(cart->ram);
-
 error_handler2:
-    free(cart->rom);
+    free(cart->ram);
 
 error_handler1:
-    fclose(rom_file);
+    cart_unload_rom(cart);
 
 error_handler0:
     return status;
@@ -240,6 +205,22 @@ void cart_write(gb_cart_t *cart, uint16_t addr, uint8_t byte)
     cart->mbc_write_func(cart, addr, byte);
 }
 
+void cart_set_map_listener(gb_cart_t *cart, cart_map_listener_t listener, void *listener_data)
+{
+    assert(cart != NULL);
+
+    cart->map_listener      = listener;
+    cart->map_listener_data = listener_data;
+}
+
+void cart_map_changed(gb_cart_t *cart)
+{
+    assert(cart != NULL);
+
+    if (cart->map_listener != NULL)
+        cart->map_listener(cart->map_listener_data);
+}
+
 void cart_deinit(gb_cart_t *cart)
 {
     gbstatus_e status = GBSTATUS_OK;
@@ -258,7 +239,168 @@ void cart_deinit(gb_cart_t *cart)
 
     cart->mbc_deinit_func(cart);
     free(cart->ram);
-    free(cart->rom);
+    cart_unload_rom(cart);
+}
+
+static gbstatus_e cart_load_rom(gb_cart_t *cart, const char *rom_path)
+{
+    gbstatus_e status = GBSTATUS_OK;
+
+    FILE *rom_file = fopen(rom_path, "rb");
+    if (rom_file == NULL)
+    {
+        GBSTATUS(GBSTATUS_IO_FAIL, "unable to open ROM file: %s", strerror(errno));
+        return status;
+    }
+
+#ifdef CART_MMAP
+    // Mapped ROM pages are shared by all instances running the same file
+    struct stat rom_stat;
+    if (fstat(fileno(rom_file), &rom_stat) == 0 && S_ISREG(rom_stat.st_mode))
+        status = cart_map_rom(cart, rom_file, rom_stat.st_size);
+    else
+        status = cart_read_rom(cart, rom_file);
+#else
+    status = cart_read_rom(cart, rom_file);
+#endif
+
+    fclose(rom_file);
+    return status;
+}
+
+#ifdef CART_MMAP
+static gbstatus_e cart_map_rom(gb_cart_t *cart, FILE *rom_file, size_t rom_file_size)
+{
+    gbstatus_e status = GBSTATUS_OK;
+
+    if (rom_file_size < ROM_BANK_SIZE * 2)
+    {
+        GBSTATUS(GBSTATUS_CART_FAIL, "ROM cannot be less than 32KB");
+        return status;
+    }
+
+    // The mapping stays valid after the file is closed
+    void *rom = mmap(NULL, rom_file_size, PROT_READ, MAP_SHARED, fileno(rom_file), 0);
+    if (rom == MAP_FAILED)
+    {
+        GBSTATUS(GBSTATUS_IO_FAIL, "unable to map ROM file: %s", strerror(errno));
+        return status;
+    }
+
+    cart->rom        = rom;
+    cart->rom_mapped = true;
+
+    status = cart_check_rom_size(cart, rom_file_size);
+    if (status != GBSTATUS_OK)
+        munmap(rom, rom_file_size);
+
+    return status;
+}
+#endif
+
+static gbstatus_e cart_read_rom(gb_cart_t *cart, FILE *rom_file)
+{
+    gbstatus_e status = GBSTATUS_OK;
+
+    // The file may be a pipe, so the size is taken from the header and checked against
+    // the amount of data actually read
+    uint8_t *rom = calloc(ROM_BANK_SIZE * 2, sizeof(uint8_t));
+    if (rom == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        goto error_handler0;
+    }
+
+    size_t bytes_read = fread(rom, sizeof(uint8_t), ROM_BANK_SIZE * 2, rom_file);
+    if (bytes_read != ROM_BANK_SIZE * 2)
+    {
+        if (ferror(rom_file))
+        {
+            GBSTATUS(GBSTATUS_IO_FAIL, "failed to read ROM");
+        }
+        else
+        {
+            GBSTATUS(GBSTATUS_CART_FAIL, "ROM cannot be less than 32KB");
+        }
+
+        goto error_handler1;
+    }
+
+    if (rom[ROM_SIZE_ADDR] <= MAX_ROM_SIZE_CODE)
+    {
+        size_t rom_size_header = (2 << rom[ROM_SIZE_ADDR]) * ROM_BANK_SIZE;
+
+        uint8_t *new_rom = realloc(rom, rom_size_header);
+        if (new_rom == NULL)
+        {
+            GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+            goto error_handler1;
+        }
+
+        rom = new_rom;
+        bytes_read += fread(rom + bytes_read, sizeof(uint8_t), rom_size_header - bytes_read, rom_file);
+
+        // Anything past the header size makes the file too long
+        if (bytes_read == rom_size_header && fgetc(rom_file) != EOF)
+            bytes_read++;
+
+        if (ferror(rom_file))
+        {
+            GBSTATUS(GBSTATUS_IO_FAIL, "failed to read ROM");
+            goto error_handler1;
+        }
+    }
+
+    cart->rom        = rom;
+    cart->rom_mapped = false;
+
+    status = cart_check_rom_size(cart, bytes_read);
+    if (status != GBSTATUS_OK)
+        goto error_handler1;
+
+    return GBSTATUS_OK;
+
+error_handler1:
+    free(rom);
+
+error_handler0:
+    return status;
+}
+
+static gbstatus_e cart_check_rom_size(gb_cart_t *cart, size_t rom_file_size)
+{
+    gbstatus_e status = GBSTATUS_OK;
+
+    uint8_t rom_size_code = cart->rom[ROM_SIZE_ADDR];
+    if (rom_size_code > MAX_ROM_SIZE_CODE)
+    {
+        GBSTATUS(GBSTATUS_CART_FAIL, "unsupported ROM size");
+        return status;
+    }
+
+    size_t rom_size_header = (2 << rom_size_code) * ROM_BANK_SIZE;
+
+    if (rom_file_size != rom_size_header)
+    {
+        GBSTATUS(GBSTATUS_CART_FAIL, "ROM file size is different from header info");
+        return status;
+    }
+
+    cart->rom_size = rom_size_header / ROM_BANK_SIZE;
+    return GBSTATUS_OK;
+}
+
+static void cart_unload_rom(gb_cart_t *cart)
+{
+#ifdef CART_MMAP
+    if (cart->rom_mapped)
+    {
+        munmap((void*)cart->rom, cart->rom_size * ROM_BANK_SIZE);
+        return;
+    }
+#endif
+
+    free((void*)cart->rom);
 }
 
 static gbstatus_e cart_load_sram(gb_cart_t *cart)
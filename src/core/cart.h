@@ -17,14 +17,18 @@ struct gb_cart;
 typedef uint8_t (*cart_read_func_t )(struct gb_cart *cart, uint16_t addr);
 typedef void    (*cart_write_func_t)(struct gb_cart *cart, uint16_t addr, uint8_t byte);
 typedef void    (*cart_misc_func_t )(struct gb_cart *cart);
+typedef void    (*cart_map_listener_t)(void *listener_data);
 
 /**
  * Represents Gameboy cartridge. 
  */
 typedef struct gb_cart
 {
-    /// Cartridge ROM banks
-    uint8_t *rom;
+    /// Cartridge ROM banks, mapped read-only from the ROM file when possible
+    const uint8_t *rom;
+
+    /// Whether the ROM is mapped rather than read into allocated memory
+    bool rom_mapped;
 
     /// Cartridge RAM banks
     uint8_t *ram;
@@ -32,6 +36,9 @@ typedef struct gb_cart
     int curr_rom_bank;
     int curr_ram_bank;
 
+    /// Currently mapped RAM bank, NULL if RAM is disabled or can't be accessed directly
+    uint8_t *mapped_ram;
+
     /// ROM size in banks
     int rom_size;
 
@@ -51,6 +58,10 @@ typedef struct gb_cart
     cart_misc_func_t  mbc_deinit_func;
     
     void *mbc_state;
+
+    /// Notified when the MBC switches banks or enables RAM
+    cart_map_listener_t map_listener;
+    void *map_listener_data;
 } gb_cart_t;
 
 /**
@@ -86,6 +97,22 @@ uint8_t cart_read(gb_cart_t *cart, uint16_t addr);
  */
 void cart_write(gb_cart_t *cart, uint16_t addr, uint8_t byte);
 
+/**
+ * Sets the function to be notified when the memory mapping changes
+ * 
+ * \param cart Cartridge instance
+ * \param listener Listener function or NULL
+ * \param listener_data Argument passed to the listener
+ */
+void cart_set_map_listener(gb_cart_t *cart, cart_map_listener_t listener, void *listener_data);
+
+/**
+ * Notifies the listener about the memory mapping change. Called by MBCs
+ * 
+ * \param cart Cartridge instance
+ */
+void cart_map_changed(gb_cart_t *cart);
+
 /**
  * Deinitializes the instance of the cartridge
  * 
@@ -0,0 +1,239 @@
+#include <assert.h>
+#include "compositor.h"
+#include "ppu.h"
+
+#ifdef COMPOSITOR_X86
+#include <immintrin.h>
+#endif
+
+/// Number of pixels in a sprite row
+#define OBJ_ROW_WIDTH 8
+
+static void compositor_bg_scalar (char *line, const char *bg_indices, uint8_t palette);
+static void compositor_obj_scalar(char *line, const char *bg_indices, const uint8_t *obj_indices,
+                                  int count, uint8_t palette, bool priority);
+
+#ifdef COMPOSITOR_X86
+static void compositor_bg_sse2 (char *line, const char *bg_indices, uint8_t palette);
+static void compositor_obj_sse2(char *line, const char *bg_indices, const uint8_t *obj_indices,
+                                int count, uint8_t palette, bool priority);
+
+static void compositor_bg_avx2(char *line, const char *bg_indices, uint8_t palette);
+
+static void compositor_output_xrgb8888_avx2(uint32_t *out, const char *line, const uint32_t palette[4]);
+#endif
+
+void compositor_init(gb_compositor_t *comp)
+{
+    assert(comp != NULL);
+
+    if (!compositor_select(comp, COMPOSITOR_AVX2) && !compositor_select(comp, COMPOSITOR_SSE2))
+        compositor_select(comp, COMPOSITOR_SCALAR);
+
+    comp->output.buffer = NULL;
+}
+
+bool compositor_select(gb_compositor_t *comp, compositor_impl_e impl)
+{
+    assert(comp != NULL);
+
+    switch (impl)
+    {
+    case COMPOSITOR_SCALAR:
+        comp->bg_func  = compositor_bg_scalar;
+        comp->obj_func = compositor_obj_scalar;
+        break;
+
+#ifdef COMPOSITOR_X86
+    case COMPOSITOR_SSE2:
+        // Always present on x86-64
+        comp->bg_func  = compositor_bg_sse2;
+        comp->obj_func = compositor_obj_sse2;
+        break;
+
+    case COMPOSITOR_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2"))
+            return false;
+
+        // Sprite rows are too short to benefit from wider vectors
+        comp->bg_func  = compositor_bg_avx2;
+        comp->obj_func = compositor_obj_sse2;
+        break;
+#endif
+
+    default:
+        return false;
+    }
+
+    comp->impl = impl;
+    return true;
+}
+
+void compositor_set_output(gb_compositor_t *comp, void *buffer, int stride,
+                           compositor_format_e format, const uint32_t palette[4])
+{
+    assert(comp != NULL);
+    assert(buffer == NULL || palette != NULL);
+
+    comp->output.buffer = buffer;
+    comp->output.stride = stride;
+    comp->output.format = format;
+
+    if (buffer != NULL)
+    {
+        for (int i = 0; i < 4; i++)
+            comp->output.palette[i] = palette[i];
+    }
+}
+
+void compositor_output_line(const gb_compositor_t *comp, int y, const char *line)
+{
+    assert(comp != NULL);
+
+    const gb_compositor_output_t *output = &comp->output;
+    if (output->buffer == NULL)
+        return;
+
+    void *out_line = (uint8_t*)output->buffer + y * output->stride;
+
+    switch (output->format)
+    {
+    case COMPOSITOR_FORMAT_XRGB8888:
+#ifdef COMPOSITOR_X86
+        if (comp->impl == COMPOSITOR_AVX2)
+        {
+            compositor_output_xrgb8888_avx2(out_line, line, output->palette);
+            break;
+        }
+#endif
+        for (int x = 0; x < GB_SCREEN_WIDTH; x++)
+            ((uint32_t*)out_line)[x] = output->palette[(int)line[x]];
+        break;
+
+    case COMPOSITOR_FORMAT_RGB565:
+        for (int x = 0; x < GB_SCREEN_WIDTH; x++)
+            ((uint16_t*)out_line)[x] = output->palette[(int)line[x]];
+        break;
+
+    case COMPOSITOR_FORMAT_INDEXED8:
+        for (int x = 0; x < GB_SCREEN_WIDTH; x++)
+            ((uint8_t*)out_line)[x] = output->palette[(int)line[x]];
+        break;
+    }
+}
+
+static void compositor_bg_scalar(char *line, const char *bg_indices, uint8_t palette)
+{
+    for (int x = 0; x < GB_SCREEN_WIDTH; x++)
+        line[x] = (palette >> (bg_indices[x] * 2)) & 0x3;
+}
+
+static void compositor_obj_scalar(char *line, const char *bg_indices, const uint8_t *obj_indices,
+                                  int count, uint8_t palette, bool priority)
+{
+    for (int x = 0; x < count; x++)
+    {
+        if ((priority && bg_indices[x] == 0) || !priority)
+        {
+            if (obj_indices[x] != 0)
+                line[x] = (palette >> (obj_indices[x] * 2)) & 0x3;
+        }
+    }
+}
+
+#ifdef COMPOSITOR_X86
+
+/**
+ * Maps 16 palette indices to shades
+ *
+ * \param indices Palette indices (0-3)
+ * \param palette Palette register value
+ * \return Shades
+ */
+static inline __m128i compositor_map_sse2(__m128i indices, uint8_t palette)
+{
+    __m128i shades = _mm_setzero_si128();
+
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i mask  = _mm_cmpeq_epi8(indices, _mm_set1_epi8(i));
+        __m128i shade = _mm_set1_epi8((palette >> (i * 2)) & 0x3);
+
+        shades = _mm_or_si128(shades, _mm_and_si128(mask, shade));
+    }
+
+    return shades;
+}
+
+static void compositor_bg_sse2(char *line, const char *bg_indices, uint8_t palette)
+{
+    // GB_SCREEN_WIDTH is a multiple of 16
+    for (int x = 0; x < GB_SCREEN_WIDTH; x += 16)
+    {
+        __m128i indices = _mm_loadu_si128((const __m128i*)&bg_indices[x]);
+        _mm_storeu_si128((__m128i*)&line[x], compositor_map_sse2(indices, palette));
+    }
+}
+
+static void compositor_obj_sse2(char *line, const char *bg_indices, const uint8_t *obj_indices,
+                                int count, uint8_t palette, bool priority)
+{
+    // Clipped sprites are rare
+    if (count != OBJ_ROW_WIDTH)
+    {
+        compositor_obj_scalar(line, bg_indices, obj_indices, count, palette, priority);
+        return;
+    }
+
+    __m128i zero    = _mm_setzero_si128();
+    __m128i indices = _mm_loadl_epi64((const __m128i*)obj_indices);
+    __m128i dst     = _mm_loadl_epi64((const __m128i*)line);
+
+    // Color 0 is transparent
+    __m128i visible = _mm_andnot_si128(_mm_cmpeq_epi8(indices, zero), _mm_set1_epi8(-1));
+
+    if (priority)
+    {
+        __m128i bg = _mm_loadl_epi64((const __m128i*)bg_indices);
+        visible = _mm_and_si128(visible, _mm_cmpeq_epi8(bg, zero));
+    }
+
+    __m128i shades = compositor_map_sse2(indices, palette);
+    dst = _mm_or_si128(_mm_andnot_si128(visible, dst), _mm_and_si128(visible, shades));
+
+    _mm_storel_epi64((__m128i*)line, dst);
+}
+
+__attribute__((target("avx2")))
+static void compositor_bg_avx2(char *line, const char *bg_indices, uint8_t palette)
+{
+    // Shades of all four indices, looked up by pshufb in each 128-bit lane
+    __m256i table = _mm256_setr_epi8(
+        palette & 0x3, (palette >> 2) & 0x3, (palette >> 4) & 0x3, (palette >> 6) & 0x3,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        palette & 0x3, (palette >> 2) & 0x3, (palette >> 4) & 0x3, (palette >> 6) & 0x3,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    // GB_SCREEN_WIDTH is a multiple of 32
+    for (int x = 0; x < GB_SCREEN_WIDTH; x += 32)
+    {
+        __m256i indices = _mm256_loadu_si256((const __m256i*)&bg_indices[x]);
+        _mm256_storeu_si256((__m256i*)&line[x], _mm256_shuffle_epi8(table, indices));
+    }
+}
+
+__attribute__((target("avx2")))
+static void compositor_output_xrgb8888_avx2(uint32_t *out, const char *line, const uint32_t palette[4])
+{
+    // Shades select palette entries through a cross-lane dword permutation
+    __m256i table = _mm256_setr_epi32(palette[0], palette[1], palette[2], palette[3], 0, 0, 0, 0);
+
+    for (int x = 0; x < GB_SCREEN_WIDTH; x += 8)
+    {
+        __m256i shades = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&line[x]));
+        _mm256_storeu_si256((__m256i*)&out[x], _mm256_permutevar8x32_epi32(table, shades));
+    }
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Scanline compositor of the PPU.
+ * Maps decoded palette indices to shades and blends sprites over the background.
+ *
+ * Vectorized implementations are picked at runtime depending on the host CPU,
+ * all of them produce exactly the same output as the scalar one.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define COMPOSITOR_X86
+#endif
+
+typedef enum
+{
+    COMPOSITOR_SCALAR,
+    COMPOSITOR_SSE2,
+    COMPOSITOR_AVX2
+} compositor_impl_e;
+
+/**
+ * Composes the BG/Window scanline
+ *
+ * \param line Framebuffer line, GB_SCREEN_WIDTH shades
+ * \param bg_indices BG/Window palette indices of the line
+ * \param palette BGP register value
+ */
+typedef void (*compositor_bg_func_t)(char *line, const char *bg_indices, uint8_t palette);
+
+/**
+ * Blends a sprite row over the scanline
+ *
+ * \param line Framebuffer line, starting at the first sprite pixel
+ * \param bg_indices BG/Window palette indices, starting at the first sprite pixel
+ * \param obj_indices Sprite palette indices, already flipped
+ * \param count Number of pixels, up to 8
+ * \param palette OBP0/OBP1 register value
+ * \param priority Sprite is drawn only over BG color 0
+ */
+typedef void (*compositor_obj_func_t)(char *line, const char *bg_indices, const uint8_t *obj_indices,
+                                      int count, uint8_t palette, bool priority);
+
+/**
+ * Host pixel formats of the output buffer
+ */
+typedef enum
+{
+    /// 32-bit pixels, palette entries are stored as is
+    COMPOSITOR_FORMAT_XRGB8888,
+
+    /// 16-bit pixels, the lower halves of palette entries are stored
+    COMPOSITOR_FORMAT_RGB565,
+
+    /// 8-bit pixels, the lowest bytes of palette entries are stored
+    COMPOSITOR_FORMAT_INDEXED8
+} compositor_format_e;
+
+/**
+ * Caller-provided buffer which receives the frame in the host format
+ */
+typedef struct gb_compositor_output
+{
+    /// Output buffer, NULL if disabled
+    void *buffer;
+
+    /// Distance between lines in bytes
+    int stride;
+
+    compositor_format_e format;
+
+    /// Host colors of the four shades
+    uint32_t palette[4];
+} gb_compositor_output_t;
+
+typedef struct gb_compositor
+{
+    compositor_impl_e impl;
+
+    compositor_bg_func_t  bg_func;
+    compositor_obj_func_t obj_func;
+
+    gb_compositor_output_t output;
+} gb_compositor_t;
+
+/**
+ * Initializes the compositor with the fastest implementation supported by the host CPU
+ *
+ * \param comp Compositor instance
+ */
+void compositor_init(gb_compositor_t *comp);
+
+/**
+ * Switches the compositor to the given implementation
+ *
+ * \param comp Compositor instance
+ * \param impl Implementation
+ * \return False if the host CPU doesn't support it, the implementation isn't changed then
+ */
+bool compositor_select(gb_compositor_t *comp, compositor_impl_e impl);
+
+/**
+ * Sets the host format output buffer.
+ * Composited scanlines which differ from the previous frame are also written there through the palette.
+ * The caller fills the new buffer with the current frame using compositor_output_line
+ *
+ * \param comp Compositor instance
+ * \param buffer Output buffer of GB_SCREEN_HEIGHT lines, NULL to disable the output
+ * \param stride Distance between lines in bytes
+ * \param format Pixel format
+ * \param palette Host colors of the four shades
+ */
+void compositor_set_output(gb_compositor_t *comp, void *buffer, int stride,
+                           compositor_format_e format, const uint32_t palette[4]);
+
+/**
+ * Writes the composited scanline to the output buffer, if it's set
+ *
+ * \param comp Compositor instance
+ * \param y Scanline number
+ * \param line Scanline shades
+ */
+void compositor_output_line(const gb_compositor_t *comp, int y, const char *line);
+
+#endif
@@ -6,9 +6,98 @@
 /// Memory access duration in clock cycles
 #define MEM_ACCESS_DURATION 4
 
+/// Maximum size of a polling loop recognized by the idle loop detector in bytes
+#define IDLE_LOOP_MAX_SIZE 16
+
 #define DISASM(instr, ...)
 //#define DISASM(instr, ...) printf(instr "\n", ##__VA_ARGS__)
 
+/**
+ * Opcode dispatch. 
+ * 
+ * With GB_THREADED_DISPATCH (GCC and Clang only) every opcode handler of cpu_run 
+ * ends with its own fetch and indirect jump to the next handler ("labels as values"), 
+ * so the host branch predictor sees one jump site per opcode instead of a single 
+ * shared switch jump. Otherwise the same handlers are compiled as a plain switch.
+ */
+#if defined(GB_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_THREADED_DISPATCH
+#endif
+
+/// Fetches the next opcode
+#define INSTR_PROLOGUE()                    \
+{                                           \
+    opcode = cpu_fetch_opcode(cpu);         \
+}
+
+/// Checks whether the batch is over: step limit, new frame, cycle deadline or breakpoint
+#define RUN_SHOULD_STOP()                                           \
+    (steps_left == 0 || cpu->gb->ppu.new_frame_ready ||             \
+     cpu->gb->scheduler.now >= deadline || cpu->pc == breakpoint)
+
+/// Handles interrupts and delayed EI, leaves the batch when it's over
+#define INSTR_EPILOGUE()                                            \
+{                                                                   \
+    int_step(&cpu->gb->intr_ctrl);                                  \
+                                                                    \
+    steps_left--;                                                   \
+    if (RUN_SHOULD_STOP())                                          \
+        goto run_done;                                              \
+}
+
+#ifdef CPU_THREADED_DISPATCH
+
+#define OPCODE(op) case op: op_##op
+
+#define DISPATCH()                          \
+{                                           \
+    INSTR_EPILOGUE();                       \
+    INSTR_PROLOGUE();                       \
+    goto *opcode_labels[opcode];            \
+}
+
+#define OPCODE_LABELS \
+    &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07, \
+    &&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F, \
+    &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17, \
+    &&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F, \
+    &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27, \
+    &&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F, \
+    &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37, \
+    &&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F, \
+    &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47, \
+    &&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F, \
+    &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57, \
+    &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F, \
+    &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67, \
+    &&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F, \
+    &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77, \
+    &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F, \
+    &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, \
+    &&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F, \
+    &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, \
+    &&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F, \
+    &&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7, \
+    &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF, \
+    &&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7, \
+    &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF, \
+    &&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7, \
+    &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF, \
+    &&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7, \
+    &&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF, \
+    &&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7, \
+    &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF, \
+    &&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7, \
+    &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF
+
+#else
+
+#define OPCODE(op) case op
+
+#define DISPATCH() break
+
+#endif
+
 /// Sets 7th bit of the flags register
 #define SET_Z(val) (cpu->reg_f = (cpu->reg_f & 0x7F) | ((val) << 7))
 
@@ -33,6 +122,9 @@
 /// Gets 4th bit of the flags register
 #define GET_C() ((cpu->reg_f >> 4) & 0x1)
 
+/// During OAM DMA the CPU can only reach HRAM and I/O registers
+#define DMA_BUS_BLOCKED(addr) (cpu->gb->ppu.dma_active && (addr) < 0xFF00)
+
 #define ZERO_CHECK(val) (((val) & 0xFF) == 0)
 
 #define CHECK_CARRY_4(val)  (((val) >> 4)  != 0)
@@ -74,10 +166,27 @@ static inline void cpu_instr_set (gb_cpu_t *cpu, int bit, uint8_t *value_ptr);
 
 
 /**
- * Updates the state of peripherals according to elapsed clock cycles.
+ * Advances the master clock, peripherals are updated when events come due.
  */
 static void sync_with_cpu(gb_cpu_t *cpu, int elapsed_cycles);
 
+/**
+ * Skips HALT refetches which can't end with an interrupt request
+ * 
+ * \param cpu CPU instance
+ */
+static void cpu_halt_fast_forward(gb_cpu_t *cpu);
+
+/**
+ * Skips iterations of a polling loop which can't see the polled value changing.
+ * Must be called after a taken backward jump.
+ * 
+ * \param cpu CPU instance
+ * \param branch_addr Address of the jump instruction
+ * \param branch_cycles Duration of the taken jump
+ */
+static void cpu_idle_loop_skip(gb_cpu_t *cpu, uint16_t branch_addr, int branch_cycles);
+
 /**
  * Emulates a memory read request from the CPU with correct timing
  * 
@@ -105,6 +214,17 @@ static uint16_t cpu_mem_read_word(gb_cpu_t *cpu, uint16_t addr);
  */
 static void cpu_mem_write(gb_cpu_t *cpu, uint16_t addr, uint8_t byte);
 
+/**
+ * Emulates an instruction fetch byte read with correct timing. 
+ * Unlike data reads, fetches aren't restricted during OAM DMA, 
+ * the same as fetches served from the decoded block cache
+ * 
+ * \param cpu CPU instance
+ * \param addr Address to read
+ * \return Byte read
+ */
+static inline uint8_t cpu_fetch_read(gb_cpu_t *cpu, uint16_t addr);
+
 /**
  * Emulates a memory write request from the CPU with correct timing
  * 
@@ -114,6 +234,31 @@ static void cpu_mem_write(gb_cpu_t *cpu, uint16_t addr, uint8_t byte);
  */
 static void cpu_mem_write_word(gb_cpu_t *cpu, uint16_t addr, uint16_t word);
 
+/**
+ * Fetches the opcode at PC with correct timing, 
+ * using the decoded block cache when possible
+ * 
+ * \param cpu CPU instance
+ * \return Opcode
+ */
+static inline uint8_t cpu_fetch_opcode(gb_cpu_t *cpu);
+
+/**
+ * Fetches an 8-bit immediate operand of the current instruction with correct timing
+ * 
+ * \param cpu CPU instance
+ * \return Operand
+ */
+static inline uint8_t cpu_fetch_imm8(gb_cpu_t *cpu);
+
+/**
+ * Fetches a 16-bit immediate operand of the current instruction with correct timing
+ * 
+ * \param cpu CPU instance
+ * \return Operand
+ */
+static inline uint16_t cpu_fetch_imm16(gb_cpu_t *cpu);
+
 /**
  * CB-prefixed opcodes handler
  * 
@@ -128,6 +273,9 @@ void cpu_init(gb_cpu_t *cpu, gb_t *gb)
     assert(gb  != NULL);
 
     cpu->gb = gb;
+    cpu->idle_loop_skip = true;
+    cpu->breakpoint     = -1;
+
     cpu_reset(cpu);
 }
 
@@ -145,6 +293,15 @@ void cpu_reset(gb_cpu_t *cpu)
     cpu->ime      = false;
     cpu->halted   = false;
     cpu->ei_delay = 0;
+
+    cpu->curr_instr = NULL;
+}
+
+void cpu_set_idle_loop_skip(gb_cpu_t *cpu, bool enabled)
+{
+    assert(cpu != NULL);
+
+    cpu->idle_loop_skip = enabled;
 }
 
 void cpu_skip_bootrom(gb_cpu_t *cpu)
@@ -196,585 +353,597 @@ void cpu_dump(gb_cpu_t *cpu)
     printf("===========================\n");
 }
 
+void cpu_set_breakpoint(gb_cpu_t *cpu, int addr)
+{
+    assert(cpu != NULL);
+
+    cpu->breakpoint = addr;
+}
+
 gbstatus_e cpu_step(gb_cpu_t *cpu)
+{
+    assert(cpu != NULL);
+
+    return cpu_run(cpu, 1);
+}
+
+gbstatus_e cpu_run(gb_cpu_t *cpu, int max_steps)
+{
+    assert(cpu != NULL);
+
+    return cpu_run_until(cpu, max_steps, SCHED_NEVER, NULL);
+}
+
+gbstatus_e cpu_run_until(gb_cpu_t *cpu, int max_steps, uint64_t deadline, cpu_stop_e *stop_reason)
 {
     gbstatus_e status = GBSTATUS_OK;
 
     assert(cpu != NULL);
+    assert(max_steps > 0);
 
-    if (cpu->ei_delay != 0)
-    {
-        cpu->ei_delay--;
-        if (cpu->ei_delay == 0)
-            cpu->ime = true;
-    }
+#ifdef CPU_THREADED_DISPATCH
+    static const void *const opcode_labels[256] = { OPCODE_LABELS };
+#endif
 
-    uint8_t opcode = cpu_mem_read(cpu, cpu->pc);
-    cpu->pc++;
+    // Loop control stays in locals
+    int steps_left = max_steps;
+    int breakpoint = cpu->breakpoint;
 
+    uint8_t  opcode    = 0;
     uint8_t  imm_val8  = 0;
     uint16_t imm_val16 = 0;
 
+next_instruction:
+    INSTR_PROLOGUE();
+
     switch (opcode)
     {
     // 8-bit loads
 #pragma region
     // ld r8, r8
 #pragma region 
-    case 0x40:
+    OPCODE(0x40):
         cpu->reg_b = cpu->reg_b;
 
         DISASM("ld b, b");
-        break;
+        DISPATCH();
 
-    case 0x41:
+    OPCODE(0x41):
         cpu->reg_b = cpu->reg_c;
 
         DISASM("ld b, c");
-        break;
+        DISPATCH();
 
-    case 0x42:
+    OPCODE(0x42):
         cpu->reg_b = cpu->reg_d;
 
         DISASM("ld b, d");
-        break;
+        DISPATCH();
 
-    case 0x43:
+    OPCODE(0x43):
         cpu->reg_b = cpu->reg_e;
 
         DISASM("ld b, e");
-        break;
+        DISPATCH();
 
-    case 0x44:
+    OPCODE(0x44):
         cpu->reg_b = cpu->reg_h;
 
         DISASM("ld b, h");
-        break;
+        DISPATCH();
         
-    case 0x45:
+    OPCODE(0x45):
         cpu->reg_b = cpu->reg_l;
 
         DISASM("ld b, l");
-        break;
+        DISPATCH();
 
-    case 0x47:
+    OPCODE(0x47):
         cpu->reg_b = cpu->reg_a;
 
         DISASM("ld b, a");
-        break;
+        DISPATCH();
 
-    case 0x48:
+    OPCODE(0x48):
         cpu->reg_c = cpu->reg_b;
 
         DISASM("ld c, b");
-        break;
+        DISPATCH();
 
-    case 0x49:
+    OPCODE(0x49):
         cpu->reg_c = cpu->reg_c;
 
         DISASM("ld c, c");
-        break;
+        DISPATCH();
 
-    case 0x4A:
+    OPCODE(0x4A):
         cpu->reg_c = cpu->reg_d;
 
         DISASM("ld c, d");
-        break;
+        DISPATCH();
 
-    case 0x4B:
+    OPCODE(0x4B):
         cpu->reg_c = cpu->reg_e;
 
         DISASM("ld c, e");
-        break;
+        DISPATCH();
 
-    case 0x4C:
+    OPCODE(0x4C):
         cpu->reg_c = cpu->reg_h;
 
         DISASM("ld c, h");
-        break;
+        DISPATCH();
 
-    case 0x4D:
+    OPCODE(0x4D):
         cpu->reg_c = cpu->reg_l;
 
         DISASM("ld c, l");
-        break;
+        DISPATCH();
 
-    case 0x4F:
+    OPCODE(0x4F):
         cpu->reg_c = cpu->reg_a;
 
         DISASM("ld c, a");
-        break;
+        DISPATCH();
 
-    case 0x50:
+    OPCODE(0x50):
         cpu->reg_d = cpu->reg_b;
 
         DISASM("ld d, b");
-        break;
+        DISPATCH();
 
-    case 0x51:
+    OPCODE(0x51):
         cpu->reg_d = cpu->reg_c;
 
         DISASM("ld d, c");
-        break;
+        DISPATCH();
 
-    case 0x52:
+    OPCODE(0x52):
         cpu->reg_d = cpu->reg_d;
 
         DISASM("ld d, d");
-        break;
+        DISPATCH();
 
-    case 0x53:
+    OPCODE(0x53):
         cpu->reg_d = cpu->reg_e;
 
         DISASM("ld d, e");
-        break;
+        DISPATCH();
 
-    case 0x54:
+    OPCODE(0x54):
         cpu->reg_d = cpu->reg_h;
 
         DISASM("ld d, h");
-        break;
+        DISPATCH();
         
-    case 0x55:
+    OPCODE(0x55):
         cpu->reg_d = cpu->reg_l;
 
         DISASM("ld d, l");
-        break;
+        DISPATCH();
 
-    case 0x57:
+    OPCODE(0x57):
         cpu->reg_d = cpu->reg_a;
 
         DISASM("ld d, a");
-        break;
+        DISPATCH();
 
-    case 0x58:
+    OPCODE(0x58):
         cpu->reg_e = cpu->reg_b;
 
         DISASM("ld e, b");
-        break;
+        DISPATCH();
 
-    case 0x59:
+    OPCODE(0x59):
         cpu->reg_e = cpu->reg_c;
 
         DISASM("ld e, c");
-        break;
+        DISPATCH();
 
-    case 0x5A:
+    OPCODE(0x5A):
         cpu->reg_e = cpu->reg_d;
 
         DISASM("ld e, d");
-        break;
+        DISPATCH();
 
-    case 0x5B:
+    OPCODE(0x5B):
         cpu->reg_e = cpu->reg_e;
 
         DISASM("ld e, e");
-        break;
+        DISPATCH();
 
-    case 0x5C:
+    OPCODE(0x5C):
         cpu->reg_e = cpu->reg_h;
 
         DISASM("ld e, h");
-        break;
+        DISPATCH();
 
-    case 0x5D:
+    OPCODE(0x5D):
         cpu->reg_e = cpu->reg_l;
 
         DISASM("ld e, l");
-        break;
+        DISPATCH();
 
-    case 0x5F:
+    OPCODE(0x5F):
         cpu->reg_e = cpu->reg_a;
 
         DISASM("ld e, a");
-        break;
+        DISPATCH();
 
-    case 0x60:
+    OPCODE(0x60):
         cpu->reg_h = cpu->reg_b;
 
         DISASM("ld h, b");
-        break;
+        DISPATCH();
 
-    case 0x61:
+    OPCODE(0x61):
         cpu->reg_h = cpu->reg_c;
 
         DISASM("ld h, c");
-        break;
+        DISPATCH();
 
-    case 0x62:
+    OPCODE(0x62):
         cpu->reg_h = cpu->reg_d;
 
         DISASM("ld h, d");
-        break;
+        DISPATCH();
 
-    case 0x63:
+    OPCODE(0x63):
         cpu->reg_h = cpu->reg_e;
 
         DISASM("ld h, e");
-        break;
+        DISPATCH();
 
-    case 0x64:
+    OPCODE(0x64):
         cpu->reg_h = cpu->reg_h;
 
         DISASM("ld h, h");
-        break;
+        DISPATCH();
         
-    case 0x65:
+    OPCODE(0x65):
         cpu->reg_h = cpu->reg_l;
 
         DISASM("ld h, l");
-        break;
+        DISPATCH();
 
-    case 0x67:
+    OPCODE(0x67):
         cpu->reg_h = cpu->reg_a;
 
         DISASM("ld h, a");
-        break;
+        DISPATCH();
 
-    case 0x68:
+    OPCODE(0x68):
         cpu->reg_l = cpu->reg_b;
 
         DISASM("ld l, b");
-        break;
+        DISPATCH();
 
-    case 0x69:
+    OPCODE(0x69):
         cpu->reg_l = cpu->reg_c;
 
         DISASM("ld l, c");
-        break;
+        DISPATCH();
 
-    case 0x6A:
+    OPCODE(0x6A):
         cpu->reg_l = cpu->reg_d;
 
         DISASM("ld l, d");
-        break;
+        DISPATCH();
 
-    case 0x6B:
+    OPCODE(0x6B):
         cpu->reg_l = cpu->reg_e;
 
         DISASM("ld l, e");
-        break;
+        DISPATCH();
 
-    case 0x6C:
+    OPCODE(0x6C):
         cpu->reg_l = cpu->reg_h;
 
         DISASM("ld l, h");
-        break;
+        DISPATCH();
 
-    case 0x6D:
+    OPCODE(0x6D):
         cpu->reg_l = cpu->reg_l;
 
         DISASM("ld l, l");
-        break;
+        DISPATCH();
 
-    case 0x6F:
+    OPCODE(0x6F):
         cpu->reg_l = cpu->reg_a;
 
         DISASM("ld l, a");
-        break;
+        DISPATCH();
 
-    case 0x78:
+    OPCODE(0x78):
         cpu->reg_a = cpu->reg_b;
 
         DISASM("ld a, b");
-        break;
+        DISPATCH();
 
-    case 0x79:
+    OPCODE(0x79):
         cpu->reg_a = cpu->reg_c;
 
         DISASM("ld a, c");
-        break;
+        DISPATCH();
 
-    case 0x7A:
+    OPCODE(0x7A):
         cpu->reg_a = cpu->reg_d;
 
         DISASM("ld a, d");
-        break;
+        DISPATCH();
 
-    case 0x7B:
+    OPCODE(0x7B):
         cpu->reg_a = cpu->reg_e;
 
         DISASM("ld a, e");
-        break;
+        DISPATCH();
 
-    case 0x7C:
+    OPCODE(0x7C):
         cpu->reg_a = cpu->reg_h;
 
         DISASM("ld a, h");
-        break;
+        DISPATCH();
 
-    case 0x7D:
+    OPCODE(0x7D):
         cpu->reg_a = cpu->reg_l;
 
         DISASM("ld a, l");
-        break;
+        DISPATCH();
 
-    case 0x7F:
+    OPCODE(0x7F):
         cpu->reg_a = cpu->reg_a;
 
         DISASM("ld a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // ld (hl), r8
 #pragma region
-    case 0x70:
+    OPCODE(0x70):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_b);
 
         DISASM("ld (hl), b");
-        break;
+        DISPATCH();
 
-    case 0x71:
+    OPCODE(0x71):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_c);
 
         DISASM("ld (hl), c");
-        break;
+        DISPATCH();
 
-    case 0x72:
+    OPCODE(0x72):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_d);
 
         DISASM("ld (hl), d");
-        break;
+        DISPATCH();
 
-    case 0x73:
+    OPCODE(0x73):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_e);
 
         DISASM("ld (hl), e");
-        break;
+        DISPATCH();
 
-    case 0x74:
+    OPCODE(0x74):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_h);
 
         DISASM("ld (hl), h");
-        break;
+        DISPATCH();
 
-    case 0x75:
+    OPCODE(0x75):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_l);
 
         DISASM("ld (hl), l");
-        break;
+        DISPATCH();
 
-    case 0x77:
+    OPCODE(0x77):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_a);
 
         DISASM("ld (hl), a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // ld r8, (hl)
 #pragma region
-    case 0x46:
+    OPCODE(0x46):
         cpu->reg_b = cpu_mem_read(cpu, cpu->reg_hl);
 
         DISASM("ld b, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x4E:
+    OPCODE(0x4E):
         cpu->reg_c = cpu_mem_read(cpu, cpu->reg_hl);
 
         DISASM("ld c, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x56:
+    OPCODE(0x56):
         cpu->reg_d = cpu_mem_read(cpu, cpu->reg_hl);
 
         DISASM("ld d, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x5E:
+    OPCODE(0x5E):
         cpu->reg_e = cpu_mem_read(cpu, cpu->reg_hl);
         DISASM("ld e, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x66:
+    OPCODE(0x66):
         cpu->reg_h = cpu_mem_read(cpu, cpu->reg_hl);
 
         DISASM("ld h, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x6E:
+    OPCODE(0x6E):
         cpu->reg_l = cpu_mem_read(cpu, cpu->reg_hl);
 
         DISASM("ld l, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x7E:
+    OPCODE(0x7E):
         cpu->reg_a = cpu_mem_read(cpu, cpu->reg_hl);
 
         DISASM("ld a, (hl)");
-        break;
+        DISPATCH();
 
 #pragma endregion
 
     // ld r8, imm8
 #pragma region
-    case 0x06:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x06):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_b = imm_val8;
 
         DISASM("ld b, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x0E:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x0E):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_c = imm_val8;
 
         DISASM("ld c, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x16:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x16):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_d = imm_val8;
 
         DISASM("ld d, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x1E:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x1E):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_e = imm_val8;
 
         DISASM("ld e, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x26:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x26):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_h = imm_val8;
 
         DISASM("ld h, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x2E:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x2E):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_l = imm_val8;
 
         DISASM("ld l, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x3E:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x3E):
+        imm_val8 = cpu_fetch_imm8(cpu);
         cpu->reg_a = imm_val8;
 
         DISASM("ld a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 #pragma endregion
 
     // etc 8-bit loads
 #pragma region
-    case 0x02:
+    OPCODE(0x02):
         cpu_mem_write(cpu, cpu->reg_bc, cpu->reg_a);
 
         DISASM("ld (bc), a");
-        break;
+        DISPATCH();
 
-    case 0x12:
+    OPCODE(0x12):
         cpu_mem_write(cpu, cpu->reg_de, cpu->reg_a);
         
         DISASM("ld (de), a");
-        break;
+        DISPATCH();
 
-    case 0x22:
+    OPCODE(0x22):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_a);
         cpu->reg_hl++;
         
         DISASM("ld (hl++), a");
-        break;
+        DISPATCH();
 
-    case 0x32:
+    OPCODE(0x32):
         cpu_mem_write(cpu, cpu->reg_hl, cpu->reg_a);
         cpu->reg_hl--;
         
         DISASM("ld (hl--), a");
-        break;
+        DISPATCH();
 
-    case 0x0A:
+    OPCODE(0x0A):
         cpu->reg_a = cpu_mem_read(cpu, cpu->reg_bc);
 
         DISASM("ld a, (bc)");
-        break;
+        DISPATCH();
 
-    case 0x1A:
+    OPCODE(0x1A):
         cpu->reg_a = cpu_mem_read(cpu, cpu->reg_de);
 
         DISASM("ld a, (de)");
-        break;
+        DISPATCH();
 
-    case 0x2A:
+    OPCODE(0x2A):
         cpu->reg_a = cpu_mem_read(cpu, cpu->reg_hl);
         cpu->reg_hl++;
 
         DISASM("ld a, (hl++)");
-        break;
+        DISPATCH();
 
-    case 0x3A:
+    OPCODE(0x3A):
         cpu->reg_a = cpu_mem_read(cpu, cpu->reg_hl);
         cpu->reg_hl--;
 
         DISASM("ld a, (hl--)");
-        break;
+        DISPATCH();
 
-    case 0x36:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0x36):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_mem_write(cpu, cpu->reg_hl, imm_val8);
 
         DISASM("ld (hl), 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xE0:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xE0):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_mem_write(cpu, 0xFF00 + imm_val8, cpu->reg_a);
         
         DISASM("ld (0xFF00 + 0x%02x), a", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xF0:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xF0):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu->reg_a = cpu_mem_read(cpu, 0xFF00 + imm_val8);
 
         DISASM("ld a, (0xFF00 + 0x%02x)", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xE2:
+    OPCODE(0xE2):
         cpu_mem_write(cpu, 0xFF00 + cpu->reg_c, cpu->reg_a);
         
         DISASM("ld (0xFF00 + c), a");
-        break;
+        DISPATCH();
 
-    case 0xF2:
+    OPCODE(0xF2):
         cpu->reg_a = cpu_mem_read(cpu, 0xFF00 + cpu->reg_c);
 
         DISASM("ld a, (0xFF00 + c)");
-        break;
+        DISPATCH();
 
-    case 0xEA:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0xEA):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu_mem_write(cpu, imm_val16, cpu->reg_a);
 
         DISASM("ld (0x%04x), a", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xFA:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0xFA):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu->reg_a = cpu_mem_read(cpu, imm_val16);
 
         DISASM("ld a, (0x%04x)", imm_val16);
-        break;
+        DISPATCH();
 #pragma endregion
 #pragma endregion
 
@@ -782,73 +951,69 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
 #pragma region
     // ld r16, imm16
 #pragma region
-    case 0x01:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0x01):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu->reg_bc = imm_val16;
 
         DISASM("ld bc, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0x11:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0x11):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu->reg_de = imm_val16;
 
         DISASM("ld de, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0x21:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0x21):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu->reg_hl = imm_val16;
 
         DISASM("ld hl, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0x31:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0x31):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu->sp = imm_val16;
 
         DISASM("ld sp, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 #pragma endregion
 
     // pop r16
 #pragma region
-    case 0xC1:
+    OPCODE(0xC1):
         imm_val16 = cpu_mem_read_word(cpu, cpu->sp);
         cpu->sp += 2;
 
         cpu->reg_bc = imm_val16;
 
         DISASM("pop bc");
-        break;
+        DISPATCH();
 
-    case 0xD1:
+    OPCODE(0xD1):
         imm_val16 = cpu_mem_read_word(cpu, cpu->sp);
         cpu->sp += 2;
 
         cpu->reg_de = imm_val16;
 
         DISASM("pop de");
-        break;
+        DISPATCH();
 
-    case 0xE1:
+    OPCODE(0xE1):
         imm_val16 = cpu_mem_read_word(cpu, cpu->sp);
         cpu->sp += 2;
 
         cpu->reg_hl = imm_val16;
 
         DISASM("pop hl");
-        break;
+        DISPATCH();
 
-    case 0xF1:
+    OPCODE(0xF1):
         imm_val16 = cpu_mem_read_word(cpu, cpu->sp);
         cpu->sp += 2;
 
@@ -856,64 +1021,63 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
         cpu->reg_f &= 0xf0; // least 4 bits of the flags register must be always zero
 
         DISASM("pop af");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // push r16
 #pragma region
-    case 0xC5:
+    OPCODE(0xC5):
         sync_with_cpu(cpu, 4); // internal timing
 
         cpu->sp -= 2;
         cpu_mem_write_word(cpu, cpu->sp, cpu->reg_bc);
 
         DISASM("push bc");
-        break;
+        DISPATCH();
 
-    case 0xD5:
+    OPCODE(0xD5):
         sync_with_cpu(cpu, 4); // internal timing
 
         cpu->sp -= 2;
         cpu_mem_write_word(cpu, cpu->sp, cpu->reg_de);
 
         DISASM("push de");
-        break;
+        DISPATCH();
 
-    case 0xE5:
+    OPCODE(0xE5):
         sync_with_cpu(cpu, 4); // internal timing
         
         cpu->sp -= 2;
         cpu_mem_write_word(cpu, cpu->sp, cpu->reg_hl);
 
         DISASM("push hl");
-        break;
+        DISPATCH();
 
-    case 0xF5:
+    OPCODE(0xF5):
         sync_with_cpu(cpu, 4); // internal timing
         
         cpu->sp -= 2;
         cpu_mem_write_word(cpu, cpu->sp, cpu->reg_af);
 
         DISASM("push af");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // etc 16-bit loads
 #pragma region
-    case 0x08:
-        imm_val16 = cpu_mem_read_word(cpu, cpu->pc);
-        cpu->pc += 2;
+    OPCODE(0x08):
+        imm_val16 = cpu_fetch_imm16(cpu);
 
         cpu_mem_write_word(cpu, imm_val16, cpu->sp);
         DISASM("ld (0x%04x), sp", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xF9:
+    OPCODE(0xF9):
         cpu->sp = cpu->reg_hl;
         sync_with_cpu(cpu, 4); // internal timing
 
         DISASM("ld sp, hl");
-        break;
+        DISPATCH();
 #pragma endregion
 #pragma endregion
     
@@ -921,633 +1085,625 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
 #pragma region
     // add a, r8
 #pragma region
-    case 0x80:
+    OPCODE(0x80):
         cpu_instr_add(cpu, cpu->reg_b);
 
         DISASM("add a, b");
-        break;
+        DISPATCH();
 
-    case 0x81:
+    OPCODE(0x81):
         cpu_instr_add(cpu, cpu->reg_c);
         
         DISASM("add a, c");
-        break;
+        DISPATCH();
 
-    case 0x82:
+    OPCODE(0x82):
         cpu_instr_add(cpu, cpu->reg_d);
         
         DISASM("add a, d");
-        break;
+        DISPATCH();
 
-    case 0x83:
+    OPCODE(0x83):
         cpu_instr_add(cpu, cpu->reg_e);
         
         DISASM("add a, e");
-        break;
+        DISPATCH();
 
-    case 0x84:
+    OPCODE(0x84):
         cpu_instr_add(cpu, cpu->reg_h);
         
         DISASM("add a, h");
-        break;
+        DISPATCH();
 
-    case 0x85:
+    OPCODE(0x85):
         cpu_instr_add(cpu, cpu->reg_l);
         
         DISASM("add a, l");
-        break;
+        DISPATCH();
 
-    case 0x87:
+    OPCODE(0x87):
         cpu_instr_add(cpu, cpu->reg_a);
         
         DISASM("add a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // adc a, r8
 #pragma region
-    case 0x88:
+    OPCODE(0x88):
         cpu_instr_adc(cpu, cpu->reg_b);
 
         DISASM("adc a, b");
-        break;
+        DISPATCH();
 
-    case 0x89:
+    OPCODE(0x89):
         cpu_instr_adc(cpu, cpu->reg_c);
         
         DISASM("adc a, c");
-        break;
+        DISPATCH();
 
-    case 0x8A:
+    OPCODE(0x8A):
         cpu_instr_adc(cpu, cpu->reg_d);
         
         DISASM("adc a, d");
-        break;
+        DISPATCH();
 
-    case 0x8B:
+    OPCODE(0x8B):
         cpu_instr_adc(cpu, cpu->reg_e);
         
         DISASM("adc a, e");
-        break;
+        DISPATCH();
 
-    case 0x8C:
+    OPCODE(0x8C):
         cpu_instr_adc(cpu, cpu->reg_h);
         
         DISASM("adc a, h");
-        break;
+        DISPATCH();
 
-    case 0x8D:
+    OPCODE(0x8D):
         cpu_instr_adc(cpu, cpu->reg_l);
         
         DISASM("adc a, l");
-        break;
+        DISPATCH();
 
-    case 0x8F:
+    OPCODE(0x8F):
         cpu_instr_adc(cpu, cpu->reg_a);
         
         DISASM("adc a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // sub a, r8
 #pragma region
-    case 0x90:
+    OPCODE(0x90):
         cpu_instr_sub(cpu, cpu->reg_b);
 
         DISASM("sub a, b");
-        break;
+        DISPATCH();
 
-    case 0x91:
+    OPCODE(0x91):
         cpu_instr_sub(cpu, cpu->reg_c);
         
         DISASM("sub a, c");
-        break;
+        DISPATCH();
 
-    case 0x92:
+    OPCODE(0x92):
         cpu_instr_sub(cpu, cpu->reg_d);
         
         DISASM("sub a, d");
-        break;
+        DISPATCH();
 
-    case 0x93:
+    OPCODE(0x93):
         cpu_instr_sub(cpu, cpu->reg_e);
         
         DISASM("sub a, e");
-        break;
+        DISPATCH();
 
-    case 0x94:
+    OPCODE(0x94):
         cpu_instr_sub(cpu, cpu->reg_h);
         
         DISASM("sub a, h");
-        break;
+        DISPATCH();
 
-    case 0x95:
+    OPCODE(0x95):
         cpu_instr_sub(cpu, cpu->reg_l);
         
         DISASM("sub a, l");
-        break;
+        DISPATCH();
 
-    case 0x97:
+    OPCODE(0x97):
         cpu_instr_sub(cpu, cpu->reg_a);
         
         DISASM("sub a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // sbc a, r8
 #pragma region
-    case 0x98:
+    OPCODE(0x98):
         cpu_instr_sbc(cpu, cpu->reg_b);
 
         DISASM("sbc a, b");
-        break;
+        DISPATCH();
 
-    case 0x99:
+    OPCODE(0x99):
         cpu_instr_sbc(cpu, cpu->reg_c);
         
         DISASM("sbc a, c");
-        break;
+        DISPATCH();
 
-    case 0x9A:
+    OPCODE(0x9A):
         cpu_instr_sbc(cpu, cpu->reg_d);
         
         DISASM("sbc a, d");
-        break;
+        DISPATCH();
 
-    case 0x9B:
+    OPCODE(0x9B):
         cpu_instr_sbc(cpu, cpu->reg_e);
         
         DISASM("sbc a, e");
-        break;
+        DISPATCH();
 
-    case 0x9C:
+    OPCODE(0x9C):
         cpu_instr_sbc(cpu, cpu->reg_h);
         
         DISASM("sbc a, h");
-        break;
+        DISPATCH();
 
-    case 0x9D:
+    OPCODE(0x9D):
         cpu_instr_sbc(cpu, cpu->reg_l);
         
         DISASM("sbc a, l");
-        break;
+        DISPATCH();
 
-    case 0x9F:
+    OPCODE(0x9F):
         cpu_instr_sbc(cpu, cpu->reg_a);
         
         DISASM("sbc a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
      // and a, r8
 #pragma region
-    case 0xA0:
+    OPCODE(0xA0):
         cpu_instr_and(cpu, cpu->reg_b);
 
         DISASM("and a, b");
-        break;
+        DISPATCH();
 
-    case 0xA1:
+    OPCODE(0xA1):
         cpu_instr_and(cpu, cpu->reg_c);
         
         DISASM("and a, c");
-        break;
+        DISPATCH();
 
-    case 0xA2:
+    OPCODE(0xA2):
         cpu_instr_and(cpu, cpu->reg_d);
         
         DISASM("and a, d");
-        break;
+        DISPATCH();
 
-    case 0xA3:
+    OPCODE(0xA3):
         cpu_instr_and(cpu, cpu->reg_e);
         
         DISASM("and a, e");
-        break;
+        DISPATCH();
 
-    case 0xA4:
+    OPCODE(0xA4):
         cpu_instr_and(cpu, cpu->reg_h);
         
         DISASM("and a, h");
-        break;
+        DISPATCH();
 
-    case 0xA5:
+    OPCODE(0xA5):
         cpu_instr_and(cpu, cpu->reg_l);
         
         DISASM("and a, l");
-        break;
+        DISPATCH();
 
-    case 0xA7:
+    OPCODE(0xA7):
         cpu_instr_and(cpu, cpu->reg_a);
         
         DISASM("and a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // xor a, r8
 #pragma region
-    case 0xA8:
+    OPCODE(0xA8):
         cpu_instr_xor(cpu, cpu->reg_b);
 
         DISASM("xor a, b");
-        break;
+        DISPATCH();
 
-    case 0xA9:
+    OPCODE(0xA9):
         cpu_instr_xor(cpu, cpu->reg_c);
         
         DISASM("xor a, c");
-        break;
+        DISPATCH();
 
-    case 0xAA:
+    OPCODE(0xAA):
         cpu_instr_xor(cpu, cpu->reg_d);
         
         DISASM("xor a, d");
-        break;
+        DISPATCH();
 
-    case 0xAB:
+    OPCODE(0xAB):
         cpu_instr_xor(cpu, cpu->reg_e);
         
         DISASM("xor a, e");
-        break;
+        DISPATCH();
 
-    case 0xAC:
+    OPCODE(0xAC):
         cpu_instr_xor(cpu, cpu->reg_h);
         
         DISASM("xor a, h");
-        break;
+        DISPATCH();
 
-    case 0xAD:
+    OPCODE(0xAD):
         cpu_instr_xor(cpu, cpu->reg_l);
         
         DISASM("xor a, l");
-        break;
+        DISPATCH();
 
-    case 0xAF:
+    OPCODE(0xAF):
         cpu_instr_xor(cpu, cpu->reg_a);
         
         DISASM("xor a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // or a, r8
 #pragma region
-    case 0xB0:
+    OPCODE(0xB0):
         cpu_instr_or(cpu, cpu->reg_b);
 
         DISASM("or a, b");
-        break;
+        DISPATCH();
 
-    case 0xB1:
+    OPCODE(0xB1):
         cpu_instr_or(cpu, cpu->reg_c);
         
         DISASM("or a, c");
-        break;
+        DISPATCH();
 
-    case 0xB2:
+    OPCODE(0xB2):
         cpu_instr_or(cpu, cpu->reg_d);
         
         DISASM("or a, d");
-        break;
+        DISPATCH();
 
-    case 0xB3:
+    OPCODE(0xB3):
         cpu_instr_or(cpu, cpu->reg_e);
         
         DISASM("or a, e");
-        break;
+        DISPATCH();
 
-    case 0xB4:
+    OPCODE(0xB4):
         cpu_instr_or(cpu, cpu->reg_h);
         
         DISASM("or a, h");
-        break;
+        DISPATCH();
 
-    case 0xB5:
+    OPCODE(0xB5):
         cpu_instr_or(cpu, cpu->reg_l);
         
         DISASM("or a, l");
-        break;
+        DISPATCH();
 
-    case 0xB7:
+    OPCODE(0xB7):
         cpu_instr_or(cpu, cpu->reg_a);
         
         DISASM("or a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // cp a, r8
 #pragma region
-    case 0xB8:
+    OPCODE(0xB8):
         cpu_instr_cp(cpu, cpu->reg_b);
 
         DISASM("cp a, b");
-        break;
+        DISPATCH();
 
-    case 0xB9:
+    OPCODE(0xB9):
         cpu_instr_cp(cpu, cpu->reg_c);
         
         DISASM("cp a, c");
-        break;
+        DISPATCH();
 
-    case 0xBA:
+    OPCODE(0xBA):
         cpu_instr_cp(cpu, cpu->reg_d);
         
         DISASM("cp a, d");
-        break;
+        DISPATCH();
 
-    case 0xBB:
+    OPCODE(0xBB):
         cpu_instr_cp(cpu, cpu->reg_e);
         
         DISASM("cp a, e");
-        break;
+        DISPATCH();
 
-    case 0xBC:
+    OPCODE(0xBC):
         cpu_instr_cp(cpu, cpu->reg_h);
         
         DISASM("cp a, h");
-        break;
+        DISPATCH();
 
-    case 0xBD:
+    OPCODE(0xBD):
         cpu_instr_cp(cpu, cpu->reg_l);
         
         DISASM("cp a, l");
-        break;
+        DISPATCH();
 
-    case 0xBF:
+    OPCODE(0xBF):
         cpu_instr_cp(cpu, cpu->reg_a);
         
         DISASM("cp a, a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // inc r8
 #pragma region
-    case 0x04:
+    OPCODE(0x04):
         cpu_instr_inc(cpu, &cpu->reg_b);
 
         DISASM("inc b");
-        break;
+        DISPATCH();
     
-    case 0x0c:
+    OPCODE(0x0C):
         cpu_instr_inc(cpu, &cpu->reg_c);
         
         DISASM("inc c");
-        break;
+        DISPATCH();
 
-    case 0x14:
+    OPCODE(0x14):
         cpu_instr_inc(cpu, &cpu->reg_d);
 
         DISASM("inc d");
-        break;
+        DISPATCH();
     
-    case 0x1c:
+    OPCODE(0x1C):
         cpu_instr_inc(cpu, &cpu->reg_e);
         
         DISASM("inc e");
-        break;
+        DISPATCH();
 
-    case 0x24:
+    OPCODE(0x24):
         cpu_instr_inc(cpu, &cpu->reg_h);
 
         DISASM("inc h");
-        break;
+        DISPATCH();
     
-    case 0x2c:
+    OPCODE(0x2C):
         cpu_instr_inc(cpu, &cpu->reg_l);
         
         DISASM("inc l");
-        break;
+        DISPATCH();
 
-    case 0x3c:
+    OPCODE(0x3C):
         cpu_instr_inc(cpu, &cpu->reg_a);
 
         DISASM("inc a");
-        break;
+        DISPATCH();
 #pragma endregion
     
     // dec r8
 #pragma region
-    case 0x05:
+    OPCODE(0x05):
         cpu_instr_dec(cpu, &cpu->reg_b);
 
         DISASM("dec b");
-        break;
+        DISPATCH();
     
-    case 0x0d:
+    OPCODE(0x0D):
         cpu_instr_dec(cpu, &cpu->reg_c);
         
         DISASM("dec c");
-        break;
+        DISPATCH();
 
-    case 0x15:
+    OPCODE(0x15):
         cpu_instr_dec(cpu, &cpu->reg_d);
 
         DISASM("dec d");
-        break;
+        DISPATCH();
     
-    case 0x1d:
+    OPCODE(0x1D):
         cpu_instr_dec(cpu, &cpu->reg_e);
         
         DISASM("dec e");
-        break;
+        DISPATCH();
 
-    case 0x25:
+    OPCODE(0x25):
         cpu_instr_dec(cpu, &cpu->reg_h);
 
         DISASM("dec h");
-        break;
+        DISPATCH();
     
-    case 0x2d:
+    OPCODE(0x2D):
         cpu_instr_dec(cpu, &cpu->reg_l);
         
         DISASM("dec l");
-        break;
+        DISPATCH();
 
-    case 0x3d:
+    OPCODE(0x3D):
         cpu_instr_dec(cpu, &cpu->reg_a);
 
         DISASM("dec a");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // OP a, (hl)
 #pragma region
-    case 0x86:
+    OPCODE(0x86):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_add(cpu, imm_val8);
 
         DISASM("add a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x96:
+    OPCODE(0x96):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_sub(cpu, imm_val8);
 
         DISASM("sub a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0xA6:
+    OPCODE(0xA6):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_and(cpu, imm_val8);
 
         DISASM("and a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0xB6:
+    OPCODE(0xB6):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_or(cpu, imm_val8);
 
         DISASM("or a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x8E:
+    OPCODE(0x8E):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_adc(cpu, imm_val8);
 
         DISASM("adc a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0x9E:
+    OPCODE(0x9E):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_sbc(cpu, imm_val8);
 
         DISASM("sbc a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0xAE:
+    OPCODE(0xAE):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_xor(cpu, imm_val8);
 
         DISASM("xor a, (hl)");
-        break;
+        DISPATCH();
 
-    case 0xBE:
+    OPCODE(0xBE):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_cp(cpu, imm_val8);
 
         DISASM("cp a, (hl)");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // OP a, imm8
 #pragma region
-    case 0xC6:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xC6):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_add(cpu, imm_val8);
 
         DISASM("add a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xD6:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xD6):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_sub(cpu, imm_val8);
 
         DISASM("sub a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xE6:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xE6):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_and(cpu, imm_val8);
 
         DISASM("and a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xF6:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xF6):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_or(cpu, imm_val8);
 
         DISASM("or a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xCE:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xCE):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_adc(cpu, imm_val8);
 
         DISASM("adc a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xDE:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xDE):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_sbc(cpu, imm_val8);
 
         DISASM("sbc a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xEE:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xEE):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_xor(cpu, imm_val8);
 
         DISASM("xor a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xFE:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xFE):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         cpu_instr_cp(cpu, imm_val8);
 
         DISASM("cp a, 0x%02x", imm_val8);
-        break;
+        DISPATCH();
 #pragma endregion
 
     // misc 8-bit arithmetic
 #pragma region
-    case 0x34:
+    OPCODE(0x34):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_inc(cpu, &imm_val8);
         cpu_mem_write(cpu, cpu->reg_hl, imm_val8);
 
         DISASM("inc (hl)");
-        break;
+        DISPATCH();
 
-    case 0x35:
+    OPCODE(0x35):
         imm_val8 = cpu_mem_read(cpu, cpu->reg_hl);
         cpu_instr_dec(cpu, &imm_val8);
         cpu_mem_write(cpu, cpu->reg_hl, imm_val8);
         
         DISASM("dec (hl)");
-        break;
+        DISPATCH();
 
-    case 0x37:
+    OPCODE(0x37):
         SET_N(0);
         SET_H(0);
         SET_C(1);
 
         DISASM("scf");
-        break;
+        DISPATCH();
 
-    case 0x3F:
+    OPCODE(0x3F):
         SET_N(0);
         SET_H(0);
         SET_C(1 - GET_C());
 
         DISASM("ccf");
-        break;
+        DISPATCH();
 
-    case 0x2F:
+    OPCODE(0x2F):
         SET_N(1);
         SET_H(1);
 
         cpu->reg_a = ~cpu->reg_a;
 
         DISASM("cpl");
-        break;
+        DISPATCH();
 
 
-    case 0x27:
+    OPCODE(0x27):
     {
         int val = cpu->reg_a;
         int correction = 0;
@@ -1574,7 +1730,7 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
         cpu->reg_a = val;
 
         DISASM("DAA");
-        break;
+        DISPATCH();
     }   
 #pragma endregion
 #pragma endregion
@@ -1583,98 +1739,97 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
 #pragma region
     // inc r16
 #pragma region
-    case 0x03:
+    OPCODE(0x03):
         cpu->reg_bc++;
         sync_with_cpu(cpu, 4); // internal
 
         DISASM("inc bc");
-        break;
+        DISPATCH();
 
-    case 0x13:
+    OPCODE(0x13):
         cpu->reg_de++;
         sync_with_cpu(cpu, 4); // internal
         
         DISASM("inc de");
-        break;
+        DISPATCH();
 
-    case 0x23:
+    OPCODE(0x23):
         cpu->reg_hl++;
         sync_with_cpu(cpu, 4); // internal
         
         DISASM("inc hl");
-        break;
+        DISPATCH();
 
-    case 0x33:
+    OPCODE(0x33):
         cpu->sp++;
         sync_with_cpu(cpu, 4); // internal
         
         DISASM("inc sp");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // dec r16
 #pragma region
-    case 0x0B:
+    OPCODE(0x0B):
         cpu->reg_bc--;
         sync_with_cpu(cpu, 4); // internal
 
         DISASM("dec bc");
-        break;
+        DISPATCH();
 
-    case 0x1B:
+    OPCODE(0x1B):
         cpu->reg_de--;
         sync_with_cpu(cpu, 4); // internal
         
         DISASM("dec de");
-        break;
+        DISPATCH();
 
-    case 0x2B:
+    OPCODE(0x2B):
         cpu->reg_hl--;
         sync_with_cpu(cpu, 4); // internal
         
         DISASM("dec hl");
-        break;
+        DISPATCH();
 
-    case 0x3B:
+    OPCODE(0x3B):
         cpu->sp--;
         sync_with_cpu(cpu, 4); // internal
         
         DISASM("dec sp");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // add hl, r16
 #pragma region
-    case 0x09:
+    OPCODE(0x09):
         cpu_instr_add_hl(cpu, cpu->reg_bc);
 
         DISASM("add hl, bc");
-        break;
+        DISPATCH();
 
-    case 0x19:
+    OPCODE(0x19):
         cpu_instr_add_hl(cpu, cpu->reg_de);
 
         DISASM("add hl, de");
-        break;
+        DISPATCH();
 
-    case 0x29:
+    OPCODE(0x29):
         cpu_instr_add_hl(cpu, cpu->reg_hl);
 
         DISASM("add hl, hl");
-        break;
+        DISPATCH();
 
-    case 0x39:
+    OPCODE(0x39):
         cpu_instr_add_hl(cpu, cpu->sp);
 
         DISASM("add hl, sp");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // misc 16-bit arithmetics
 #pragma region
-    case 0xE8:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xE8):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         SET_Z(0);
         SET_N(0);
@@ -1686,11 +1841,10 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
         sync_with_cpu(cpu, 8); // internal
 
         DISASM("add sp, %d", (int8_t)imm_val8);
-        break;
+        DISPATCH();
 
-    case 0xF8:
-        imm_val8 = cpu_mem_read(cpu, cpu->pc);
-        cpu->pc++;
+    OPCODE(0xF8):
+        imm_val8 = cpu_fetch_imm8(cpu);
 
         SET_Z(0);
         SET_N(0);
@@ -1702,7 +1856,7 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
         sync_with_cpu(cpu, 4); // internal
 
         DISASM("ld hl, sp%+d", (int8_t)imm_val8);
-        break;
+        DISPATCH();
 #pragma endregion
 #pragma endregion
     
@@ -1710,309 +1864,486 @@ gbstatus_e cpu_step(gb_cpu_t *cpu)
 #pragma region
     // absolute jumps
 #pragma region
-    case 0xC2:
+    OPCODE(0xC2):
         imm_val16 = cpu_instr_jp_cond(cpu, 1 - GET_Z());
 
         DISASM("jp nz, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xD2:
+    OPCODE(0xD2):
         imm_val16 = cpu_instr_jp_cond(cpu, 1 - GET_C());
 
         DISASM("jp nc, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xCA:
+    OPCODE(0xCA):
         imm_val16 = cpu_instr_jp_cond(cpu, GET_Z());
 
         DISASM("jp z, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xDA:
+    OPCODE(0xDA):
         imm_val16 = cpu_instr_jp_cond(cpu, GET_C());
 
         DISASM("jp c, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xC3:
+    OPCODE(0xC3):
         imm_val16 = cpu_instr_jp_cond(cpu, true);
 
         DISASM("jp 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xE9:
+    OPCODE(0xE9):
         cpu->pc = cpu->reg_hl;
 
         DISASM("jp hl");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // relative jumps
 #pragma region
-    case 0x20:
+    OPCODE(0x20):
         imm_val8 = cpu_instr_jr_cond(cpu, 1 - GET_Z());
 
         DISASM("jr nz, %d", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x30:
+    OPCODE(0x30):
         imm_val8 = cpu_instr_jr_cond(cpu, 1 - GET_C());
 
         DISASM("jr nc, %d", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x28:
+    OPCODE(0x28):
         imm_val8 = cpu_instr_jr_cond(cpu, GET_Z());
 
         DISASM("jr z, %d", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x38:
+    OPCODE(0x38):
         imm_val8 = cpu_instr_jr_cond(cpu, GET_C());
 
         DISASM("jr c, %d", imm_val8);
-        break;
+        DISPATCH();
 
-    case 0x18:
+    OPCODE(0x18):
         imm_val8 = cpu_instr_jr_cond(cpu, true);
 
         DISASM("jr %d", imm_val8);
-        break;
+        DISPATCH();
 #pragma endregion
 
     // calls
 #pragma region
-    case 0xC4:
+    OPCODE(0xC4):
         imm_val16 = cpu_instr_call_cond(cpu, 1 - GET_Z());
 
         DISASM("call nz, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xD4:
+    OPCODE(0xD4):
         imm_val16 = cpu_instr_call_cond(cpu, 1 - GET_C());
 
         DISASM("call nc, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xCC:
+    OPCODE(0xCC):
         imm_val16 = cpu_instr_call_cond(cpu, GET_Z());
 
         DISASM("call z, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xDC:
+    OPCODE(0xDC):
         imm_val16 = cpu_instr_call_cond(cpu, GET_C());
 
         DISASM("call c, 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 
-    case 0xCD:
+    OPCODE(0xCD):
         imm_val16 = cpu_instr_call_cond(cpu, true);
 
         DISASM("call 0x%04x", imm_val16);
-        break;
+        DISPATCH();
 #pragma endregion
 
     // returns
 #pragma region
-    case 0xC0:
+    OPCODE(0xC0):
         cpu_instr_ret_cond(cpu, 1 - GET_Z());
 
         DISASM("ret nz");
-        break;
+        DISPATCH();
 
-    case 0xD0:
+    OPCODE(0xD0):
         cpu_instr_ret_cond(cpu, 1 - GET_C());
 
         DISASM("ret nc");
-        break;
+        DISPATCH();
 
-    case 0xC8:
+    OPCODE(0xC8):
         cpu_instr_ret_cond(cpu, GET_Z());
 
         DISASM("ret z");
-        break;
+        DISPATCH();
 
-    case 0xD8:
+    OPCODE(0xD8):
         cpu_instr_ret_cond(cpu, GET_C());
 
         DISASM("ret c");
-        break;
+        DISPATCH();
 
-    case 0xC9:
+    OPCODE(0xC9):
         imm_val16 = cpu_mem_read_word(cpu, cpu->sp);
         cpu->sp += 2;
 
         cpu_jump(cpu, imm_val16);
 
         DISASM("ret");
-        break;
+        DISPATCH();
 
-    case 0xD9:
+    OPCODE(0xD9):
         imm_val16 = cpu_mem_read_word(cpu, cpu->sp);
         cpu->sp += 2;
 
         cpu_jump(cpu, imm_val16);
 
         cpu->ime = true;
+        int_update_serviceable(&cpu->gb->intr_ctrl);
+
         DISASM("reti");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // resets
 #pragma region
-    case 0xC7:
+    OPCODE(0xC7):
         cpu_instr_rst(cpu, 0x00);
 
         DISASM("rst 00h");
-        break;
+        DISPATCH();
 
-    case 0xD7:
+    OPCODE(0xD7):
         cpu_instr_rst(cpu, 0x10);
 
         DISASM("rst 10h");
-        break;
+        DISPATCH();
 
-    case 0xE7:
+    OPCODE(0xE7):
         cpu_instr_rst(cpu, 0x20);
 
         DISASM("rst 20h");
-        break;
+        DISPATCH();
 
-    case 0xF7:
+    OPCODE(0xF7):
         cpu_instr_rst(cpu, 0x30);
 
         DISASM("rst 30h");
-        break;
+        DISPATCH();
 
-    case 0xCF:
+    OPCODE(0xCF):
         cpu_instr_rst(cpu, 0x08);
 
         DISASM("rst 08h");
-        break;
+        DISPATCH();
 
-    case 0xDF:
+    OPCODE(0xDF):
         cpu_instr_rst(cpu, 0x18);
 
         DISASM("rst 18h");
-        break;
+        DISPATCH();
 
-    case 0xEF:
+    OPCODE(0xEF):
         cpu_instr_rst(cpu, 0x28);
 
         DISASM("rst 28h");
-        break;
+        DISPATCH();
 
-    case 0xFF:
+    OPCODE(0xFF):
         cpu_instr_rst(cpu, 0x38);
 
         DISASM("rst 38h");
-        break;
+        DISPATCH();
 #pragma endregion
 #pragma endregion
 
     // control (misc)
 #pragma region
-    case 0x00:
+    OPCODE(0x00):
         DISASM("nop");
-        break;
+        DISPATCH();
 
-    case 0x10:
+    OPCODE(0x10):
         /// TODO: stop
         DISASM("stop");
-        break;
+        DISPATCH();
 
-    case 0x76:
+    OPCODE(0x76):
         cpu->halted = true;
         cpu->pc--;
 
+        int_update_serviceable(&cpu->gb->intr_ctrl);
+
+        cpu_halt_fast_forward(cpu);
+
         DISASM("halt");
-        break;
+        DISPATCH();
 
-    case 0xF3:
+    OPCODE(0xF3):
         cpu->ime = false;
         cpu->ei_delay = 0;
+        int_update_serviceable(&cpu->gb->intr_ctrl);
 
         DISASM("di");
-        break;
+        DISPATCH();
 
-    case 0xFB:
+    OPCODE(0xFB):
         cpu->ime = false;
         cpu->ei_delay = 2;
+        int_update_serviceable(&cpu->gb->intr_ctrl);
 
         DISASM("ei");
-        break;
+        DISPATCH();
 #pragma endregion
 
     // misc
 #pragma region
-    case 0x07:
+    OPCODE(0x07):
         cpu_instr_rlc(cpu, &cpu->reg_a);
         SET_Z(0);
 
         DISASM("rlca");
-        break;
+        DISPATCH();
 
-    case 0x17:
+    OPCODE(0x17):
         cpu_instr_rl(cpu, &cpu->reg_a);
         SET_Z(0);
 
         DISASM("rla");
-        break;
+        DISPATCH();
 
-    case 0x0F:
+    OPCODE(0x0F):
         cpu_instr_rrc(cpu, &cpu->reg_a);
         SET_Z(0);
 
         DISASM("rrca");
-        break;
+        DISPATCH();
 
-    case 0x1F:
+    OPCODE(0x1F):
         cpu_instr_rr(cpu, &cpu->reg_a);
         SET_Z(0);
 
         DISASM("rra");
-        break;
+        DISPATCH();
 
-    case 0xCB:
+    OPCODE(0xCB):
         cpu_step_cb(cpu);
-        break;
-
-    case 0xD3:
-    case 0xE3:
-    case 0xE4:
-    case 0xF4:
-    case 0xDB:
-    case 0xEB:
-    case 0xEC:
-    case 0xFC:
-    case 0xDD:
-    case 0xED:
-    case 0xFD:
+        DISPATCH();
+
+    OPCODE(0xD3):
+    OPCODE(0xE3):
+    OPCODE(0xE4):
+    OPCODE(0xF4):
+    OPCODE(0xDB):
+    OPCODE(0xEB):
+    OPCODE(0xEC):
+    OPCODE(0xFC):
+    OPCODE(0xDD):
+    OPCODE(0xED):
+    OPCODE(0xFD):
         GBSTATUS(GBSTATUS_CPU_ILLEGAL_OP, "illegal opcode: 0x%02x", opcode);
+        if (stop_reason != NULL)
+            *stop_reason = CPU_STOP_ERROR;
+
         return status;
 
 #pragma endregion
     }
 
-    int_step(&cpu->gb->intr_ctrl);
+    INSTR_EPILOGUE();
+    goto next_instruction;
+
+run_done:
+    if (stop_reason != NULL)
+    {
+        if (cpu->gb->ppu.new_frame_ready)
+            *stop_reason = CPU_STOP_FRAME;
+        else if (cpu->pc == breakpoint)
+            *stop_reason = CPU_STOP_BREAKPOINT;
+        else if (cpu->gb->scheduler.now >= deadline)
+            *stop_reason = CPU_STOP_CYCLES;
+        else
+            *stop_reason = CPU_STOP_STEPS;
+    }
+
     return GBSTATUS_OK;
 }
 
 
 static void sync_with_cpu(gb_cpu_t *cpu, int elapsed_cycles)
+{
+    scheduler_advance(&cpu->gb->scheduler, elapsed_cycles);
+}
+
+static void cpu_halt_fast_forward(gb_cpu_t *cpu)
+{
+    gb_t *gb = cpu->gb;
+
+    // Let the interrupt or delayed EI be handled as usual
+    if (cpu->ei_delay != 0 || gb->intr_ctrl.pending != 0)
+        return;
+
+    // Interrupts are requested only by scheduled events (joypad is updated
+    // between frames), so the state of the halted CPU can't change until one of them happens
+    uint64_t cycles_to_event = scheduler_cycles_to_event(&gb->scheduler);
+    if (cycles_to_event == 0)
+        return;
+
+    // Each refetch takes one memory access, the one reaching the event is left to run
+    uint64_t skipped_cycles = (cycles_to_event - 1) / MEM_ACCESS_DURATION * MEM_ACCESS_DURATION;
+    if (skipped_cycles > 0)
+        sync_with_cpu(cpu, (int)skipped_cycles);
+}
+
+static void cpu_idle_loop_skip(gb_cpu_t *cpu, uint16_t branch_addr, int branch_cycles)
 {
     gb_t *gb = cpu->gb;
+    gb_mmu_t *mmu = &gb->mmu;
+
+    uint16_t loop_start = cpu->pc;
+
+    // Interrupt or delayed EI would break the loop
+    if (cpu->ei_delay != 0 || (cpu->ime && gb->intr_ctrl.pending != 0))
+        return;
+
+    // Loop code must be readable without side effects
+    if (branch_addr >= 0xFE00 && loop_start < 0xFF80)
+        return;
+
+    // Polled memory may be unreachable until the OAM DMA ends
+    if (gb->ppu.dma_active)
+        return;
+
+    // Polled value must be loaded to A before anything else
+    uint8_t opcode = mmu_read(mmu, loop_start);
+    if (opcode != 0xF0 && opcode != 0xFA)
+        return;
+
+    // Run one iteration over a copy of the registers. If it ends up where it has started,
+    // all the following ones do the same until one of polled registers changes.
+    gb_cpu_t iter = *cpu;
+
+    int  loop_cycles = branch_cycles;
+    bool reads_div   = false;
+
+    uint16_t addr = loop_start;
+    while (addr < branch_addr)
+    {
+        opcode = mmu_read(mmu, addr);
+        uint8_t imm = mmu_read(mmu, addr + 1);
+
+        switch (opcode)
+        {
+        case 0xF0: // ldh a, (a8)
+        case 0xFA: // ld a, (a16)
+        {
+            uint16_t reg_addr = opcode == 0xF0 ? 0xFF00 | imm : imm | (mmu_read(mmu, addr + 2) << 8);
+
+            // Only registers changed by scheduled events or DIV ticks, they have no read side effects
+            if (reg_addr != 0xFF04 && reg_addr != 0xFF0F && reg_addr != 0xFF41 && reg_addr != 0xFF44)
+                return;
+
+            reads_div |= reg_addr == 0xFF04;
+
+            iter.reg_a   = mmu_read(mmu, reg_addr);
+            loop_cycles += opcode == 0xF0 ? 12 : 16;
+            addr        += opcode == 0xF0 ? 2 : 3;
+            break;
+        }
+
+        case 0xFE: // cp d8
+            cpu_instr_cp(&iter, imm);
+            loop_cycles += 8;
+            addr        += 2;
+            break;
+
+        case 0xE6: // and d8
+            cpu_instr_and(&iter, imm);
+            loop_cycles += 8;
+            addr        += 2;
+            break;
+
+        case 0xEE: // xor d8
+            cpu_instr_xor(&iter, imm);
+            loop_cycles += 8;
+            addr        += 2;
+            break;
+
+        case 0xF6: // or d8
+            cpu_instr_or(&iter, imm);
+            loop_cycles += 8;
+            addr        += 2;
+            break;
+
+        case 0xCB: // bit n, a
+            if ((imm & 0xC7) != 0x47)
+                return;
+
+            cpu_instr_bit(&iter, (imm >> 3) & 0x7, &iter.reg_a);
+            loop_cycles += 8;
+            addr        += 2;
+            break;
+
+        default:
+            return;
+        }
+    }
+
+    if (addr != branch_addr)
+        return;
+
+    // Check that the loop is taken again
+    opcode = mmu_read(mmu, branch_addr);
+    if (opcode != 0x18 && opcode != 0xC3)
+    {
+        bool flag_z = (iter.reg_f >> 7) & 0x1;
+        bool flag_c = (iter.reg_f >> 4) & 0x1;
+
+        // nz, z, nc, c
+        bool taken = false;
+        switch ((opcode >> 3) & 0x3)
+        {
+        case 0: taken = !flag_z; break;
+        case 1: taken =  flag_z; break;
+        case 2: taken = !flag_c; break;
+        case 3: taken =  flag_c; break;
+        }
+
+        if (!taken)
+            return;
+    }
 
-    timer_update(&gb->timer, elapsed_cycles);
-    ppu_update(&gb->ppu, elapsed_cycles);
+    if (iter.reg_a != cpu->reg_a || iter.reg_f != cpu->reg_f)
+        return;
+
+    uint64_t cycles_to_change = scheduler_cycles_to_event(&gb->scheduler);
+    if (reads_div && (uint64_t)timer_cycles_to_div_tick(&gb->timer) < cycles_to_change)
+        cycles_to_change = timer_cycles_to_div_tick(&gb->timer);
+
+    // Every access of skipped iterations must happen before the change
+    if (cycles_to_change == 0)
+        return;
+
+    uint64_t skipped_iters = (cycles_to_change - 1) / loop_cycles;
+    if (skipped_iters > 0)
+        sync_with_cpu(cpu, (int)(skipped_iters * loop_cycles));
 }
 
 static uint8_t cpu_mem_read(gb_cpu_t *cpu, uint16_t addr)
 {
     // Memory access takes some time
     sync_with_cpu(cpu, MEM_ACCESS_DURATION);
-    return mmu_read(&cpu->gb->mmu, addr);
+    return DMA_BUS_BLOCKED(addr) ? 0xFF : mmu_read(&cpu->gb->mmu, addr);
 }
 
 static uint16_t cpu_mem_read_word(gb_cpu_t *cpu, uint16_t addr)
@@ -2021,29 +2352,92 @@ static uint16_t cpu_mem_read_word(gb_cpu_t *cpu, uint16_t addr)
 
     // Memory access takes some time
     sync_with_cpu(cpu, MEM_ACCESS_DURATION);
-    word = mmu_read(&cpu->gb->mmu, addr);
+    word = DMA_BUS_BLOCKED(addr) ? 0xFF : mmu_read(&cpu->gb->mmu, addr);
 
     sync_with_cpu(cpu, MEM_ACCESS_DURATION);
-    word |= mmu_read(&cpu->gb->mmu, addr + 1) << 8;
+    word |= (DMA_BUS_BLOCKED(addr + 1) ? 0xFF : mmu_read(&cpu->gb->mmu, addr + 1)) << 8;
 
     return word;
 }
 
+static inline uint8_t cpu_fetch_read(gb_cpu_t *cpu, uint16_t addr)
+{
+    // Memory access takes some time
+    sync_with_cpu(cpu, MEM_ACCESS_DURATION);
+    return mmu_read(&cpu->gb->mmu, addr);
+}
+
+static inline uint8_t cpu_fetch_opcode(gb_cpu_t *cpu)
+{
+    uint8_t opcode = 0;
+
+    cpu->curr_instr = block_cache_fetch(&cpu->gb->block_cache, cpu->pc);
+    if (cpu->curr_instr != NULL)
+    {
+        sync_with_cpu(cpu, MEM_ACCESS_DURATION);
+        opcode = cpu->curr_instr->opcode;
+    }
+    else
+        opcode = cpu_fetch_read(cpu, cpu->pc);
+
+    cpu->pc++;
+    return opcode;
+}
+
+static inline uint8_t cpu_fetch_imm8(gb_cpu_t *cpu)
+{
+    uint8_t imm_val8 = 0;
+
+    if (cpu->curr_instr != NULL)
+    {
+        sync_with_cpu(cpu, MEM_ACCESS_DURATION);
+        imm_val8 = cpu->curr_instr->operand & 0xFF;
+    }
+    else
+        imm_val8 = cpu_fetch_read(cpu, cpu->pc);
+
+    cpu->pc++;
+    return imm_val8;
+}
+
+static inline uint16_t cpu_fetch_imm16(gb_cpu_t *cpu)
+{
+    uint16_t imm_val16 = 0;
+
+    if (cpu->curr_instr != NULL)
+    {
+        sync_with_cpu(cpu, MEM_ACCESS_DURATION);
+        sync_with_cpu(cpu, MEM_ACCESS_DURATION);
+        imm_val16 = cpu->curr_instr->operand;
+    }
+    else
+    {
+        imm_val16  = cpu_fetch_read(cpu, cpu->pc);
+        imm_val16 |= cpu_fetch_read(cpu, cpu->pc + 1) << 8;
+    }
+
+    cpu->pc += 2;
+    return imm_val16;
+}
+
 static void cpu_mem_write(gb_cpu_t *cpu, uint16_t addr, uint8_t byte)
 {
     // Memory access takes some time
     sync_with_cpu(cpu, MEM_ACCESS_DURATION);
-    mmu_write(&cpu->gb->mmu, addr, byte);
+    if (!DMA_BUS_BLOCKED(addr))
+        mmu_write(&cpu->gb->mmu, addr, byte);
 }
 
 static void cpu_mem_write_word(gb_cpu_t *cpu, uint16_t addr, uint16_t word)
 {
     // Memory access takes some time
     sync_with_cpu(cpu, MEM_ACCESS_DURATION);
-    mmu_write(&cpu->gb->mmu, addr, word & 0xFF);
+    if (!DMA_BUS_BLOCKED(addr))
+        mmu_write(&cpu->gb->mmu, addr, word & 0xFF);
 
     sync_with_cpu(cpu, MEM_ACCESS_DURATION);
-    mmu_write(&cpu->gb->mmu, addr + 1, word >> 8);
+    if (!DMA_BUS_BLOCKED(addr + 1))
+        mmu_write(&cpu->gb->mmu, addr + 1, word >> 8);
 }
 
 static inline void cpu_jump(gb_cpu_t *cpu, uint16_t location)
@@ -2166,30 +2560,38 @@ static inline void cpu_instr_add_hl(gb_cpu_t *cpu, uint16_t value)
 
 static inline uint16_t cpu_instr_jp_cond(gb_cpu_t *cpu, bool condition)
 {
-    uint16_t new_pc = cpu_mem_read_word(cpu, cpu->pc);
-    cpu->pc += 2;
+    uint16_t new_pc = cpu_fetch_imm16(cpu);
 
     if (condition)
+    {
+        uint16_t branch_addr = cpu->pc - 3;
         cpu_jump(cpu, new_pc);
 
+        if (cpu->idle_loop_skip && new_pc < branch_addr && branch_addr - new_pc <= IDLE_LOOP_MAX_SIZE)
+            cpu_idle_loop_skip(cpu, branch_addr, 16);
+    }
+
     return new_pc;
 }
 
 static inline int8_t cpu_instr_jr_cond(gb_cpu_t *cpu, bool condition)
 {
-    int8_t disp = (int8_t)cpu_mem_read(cpu, cpu->pc);
-    cpu->pc++;
+    int8_t disp = (int8_t)cpu_fetch_imm8(cpu);
 
     if (condition)
+    {
         cpu_jump(cpu, cpu->pc + disp);
 
+        if (cpu->idle_loop_skip && disp < 0 && disp >= -IDLE_LOOP_MAX_SIZE - 2)
+            cpu_idle_loop_skip(cpu, cpu->pc - disp - 2, 12);
+    }
+
     return disp;
 }
 
 static inline uint16_t cpu_instr_call_cond(gb_cpu_t *cpu, bool condition)
 {
-    uint16_t new_pc = cpu_mem_read_word(cpu, cpu->pc);
-    cpu->pc += 2;
+    uint16_t new_pc = cpu_fetch_imm16(cpu);
 
     if (condition)
     {
@@ -2334,8 +2736,7 @@ static inline void cpu_instr_set(gb_cpu_t *cpu, int bit, uint8_t *value_ptr)
 
 static void cpu_step_cb(gb_cpu_t *cpu)
 {
-    uint8_t opcode = cpu_mem_read(cpu, cpu->pc);
-    cpu->pc++;
+    uint8_t opcode = cpu_fetch_imm8(cpu);
 
     uint8_t imm_val8 = 0;
 
@@ -7,6 +7,28 @@
 #include "gbstatus.h"
 
 struct gb;
+struct gb_decoded_instr;
+
+/**
+ * Reasons for the CPU to leave a batch of instructions
+ */
+typedef enum
+{
+    /// Step limit is reached
+    CPU_STOP_STEPS,
+
+    /// PPU has a new frame ready
+    CPU_STOP_FRAME,
+
+    /// Cycle deadline is reached
+    CPU_STOP_CYCLES,
+
+    /// PC reached the breakpoint
+    CPU_STOP_BREAKPOINT,
+
+    /// Emulation error
+    CPU_STOP_ERROR
+} cpu_stop_e;
 
 /**
  * Gameboy CPU representation
@@ -68,12 +90,21 @@ typedef struct gb_cpu
     /// Interrupt master switch
     bool ime;
 
+    /// Skip polling loops forward in time (see cpu_set_idle_loop_skip)
+    bool idle_loop_skip;
+
+    /// Breakpoint address, -1 if there is none
+    int breakpoint;
+
     /// Program counter
     uint16_t pc;
 
     /// Stack pointer
     uint16_t sp;
 
+    /// Decoded form of the current instruction, NULL if it isn't cached
+    const struct gb_decoded_instr *curr_instr;
+
     /// Pointer to the parent Gameboy structure
     struct gb *gb;
 
@@ -101,6 +132,16 @@ void cpu_reset(gb_cpu_t *cpu);
  */
 void cpu_skip_bootrom(gb_cpu_t *cpu);
 
+/**
+ * Enables or disables skipping of idle loops. Short loops which only poll
+ * LY, STAT, DIV or IF are fast-forwarded to the moment the polled value changes.
+ * Emulation results are the same either way.
+ * 
+ * \param cpu CPU instance
+ * \param enabled True to enable
+ */
+void cpu_set_idle_loop_skip(gb_cpu_t *cpu, bool enabled);
+
 /**
  * Makes an interrupt request to the CPU
  * 
@@ -124,4 +165,33 @@ void cpu_dump(gb_cpu_t *cpu);
  */
 gbstatus_e cpu_step(gb_cpu_t *cpu);
 
+/**
+ * Fetches and executes a batch of CPU instructions. 
+ * Stops earlier if the PPU has a new frame ready.
+ * 
+ * \param cpu CPU instance
+ * \param max_steps Maximum number of instructions to execute
+ */
+gbstatus_e cpu_run(gb_cpu_t *cpu, int max_steps);
+
+/**
+ * Fetches and executes a batch of CPU instructions. 
+ * Stops earlier if the PPU has a new frame ready, the master clock reaches
+ * the deadline or PC reaches the breakpoint (checked after each instruction).
+ * 
+ * \param cpu CPU instance
+ * \param max_steps Maximum number of instructions to execute
+ * \param deadline Master clock value to stop at
+ * \param stop_reason Receives the reason to stop, may be NULL
+ */
+gbstatus_e cpu_run_until(gb_cpu_t *cpu, int max_steps, uint64_t deadline, cpu_stop_e *stop_reason);
+
+/**
+ * Sets the address to stop execution at
+ * 
+ * \param cpu CPU instance
+ * \param addr Breakpoint address, -1 to remove the breakpoint
+ */
+void cpu_set_breakpoint(gb_cpu_t *cpu, int addr);
+
 #endif
@@ -0,0 +1,47 @@
+#include <assert.h>
+#include <string.h>
+#include "frame_queue.h"
+
+#define FRAME_QUEUE_INDEX_MASK 0x3
+#define FRAME_QUEUE_FRESH      0x4
+
+void frame_queue_init(gb_frame_queue_t *queue, int frame_size)
+{
+    assert(queue != NULL);
+    assert(frame_size > 0 && frame_size <= FRAME_QUEUE_MAX_FRAME_SIZE);
+
+    memset(queue->buffers, 0, sizeof(queue->buffers));
+
+    queue->frame_size = frame_size;
+
+    queue->back  = 0;
+    queue->front = 1;
+    atomic_init(&queue->middle, 2);
+}
+
+void frame_queue_publish(gb_frame_queue_t *queue, const void *frame)
+{
+    assert(queue != NULL);
+    assert(frame != NULL);
+
+    memcpy(queue->buffers[queue->back], frame, queue->frame_size);
+
+    // Release makes the frame contents visible to the consumer together with the index
+    int prev = atomic_exchange_explicit(&queue->middle, queue->back | FRAME_QUEUE_FRESH,
+                                        memory_order_acq_rel);
+
+    queue->back = prev & FRAME_QUEUE_INDEX_MASK;
+}
+
+const void *frame_queue_acquire(gb_frame_queue_t *queue)
+{
+    assert(queue != NULL);
+
+    if (!(atomic_load_explicit(&queue->middle, memory_order_relaxed) & FRAME_QUEUE_FRESH))
+        return NULL;
+
+    int prev = atomic_exchange_explicit(&queue->middle, queue->front, memory_order_acq_rel);
+
+    queue->front = prev & FRAME_QUEUE_INDEX_MASK;
+    return queue->buffers[queue->front];
+}
@@ -0,0 +1,61 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <stdatomic.h>
+#include "ppu.h"
+
+/// Enough for 32-bit host pixels
+#define FRAME_QUEUE_MAX_FRAME_SIZE (GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT * 4)
+
+/**
+ * Lock-free triple buffer for handing finished frames from the emulation thread
+ * to the presentation thread.
+ *
+ * The producer always owns the back buffer and the consumer always owns the front one,
+ * buffers are exchanged through the middle slot with a single atomic swap.
+ * Neither side ever waits for the other, the consumer just gets the latest frame
+ * and intermediate ones are dropped.
+ */
+typedef struct gb_frame_queue
+{
+    uint8_t buffers[3][FRAME_QUEUE_MAX_FRAME_SIZE];
+
+    /// Frame size in bytes
+    int frame_size;
+
+    /// Buffer index owned by the producer
+    int back;
+
+    /// Buffer index owned by the consumer
+    int front;
+
+    /// Buffer index in the middle slot, FRAME_QUEUE_FRESH is set if it wasn't consumed yet
+    atomic_int middle;
+} gb_frame_queue_t;
+
+/**
+ * Initializes the queue
+ *
+ * \param queue Queue instance
+ * \param frame_size Frame size in bytes, up to FRAME_QUEUE_MAX_FRAME_SIZE
+ */
+void frame_queue_init(gb_frame_queue_t *queue, int frame_size);
+
+/**
+ * Publishes a frame. Must be called only from the producer thread
+ *
+ * \param queue Queue instance
+ * \param frame Frame of frame_size bytes
+ */
+void frame_queue_publish(gb_frame_queue_t *queue, const void *frame);
+
+/**
+ * Takes the latest published frame. Must be called only from the consumer thread.
+ * The frame stays valid until the next call.
+ *
+ * \param queue Queue instance
+ * \return Frame or NULL if nothing was published since the previous call
+ */
+const void *frame_queue_acquire(gb_frame_queue_t *queue);
+
+#endif
@@ -6,7 +6,10 @@
 #include "interrupts.h"
 #include "timer.h"
 #include "ppu.h"
+#include "apu.h"
 #include "joypad.h"
+#include "scheduler.h"
+#include "block_cache.h"
 
 /**
  * Abstract model of the Gameboy
@@ -16,9 +19,12 @@ typedef struct gb
     gb_cpu_t            cpu;
     gb_mmu_t            mmu;
     gb_ppu_t            ppu;
+    gb_apu_t            apu;
     gb_int_controller_t intr_ctrl;
     gb_timer_t          timer;
     gb_joypad_t         joypad;
+    gb_scheduler_t      scheduler;
+    gb_block_cache_t    block_cache;
 } gb_t;
 
 #endif
\ No newline at end of file
@@ -1,6 +1,16 @@
 #include <assert.h>
+#include <limits.h>
 #include "gb_emu.h"
 
+/**
+ * Runs the CPU until the deadline, a new frame or the breakpoint
+ * 
+ * \param gb_emu Emulator instance
+ * \param deadline Master clock value to stop at
+ * \param stop_reason Receives the reason to stop, may be NULL
+ */
+static gbstatus_e gb_emu_run_until(gb_emu_t *gb_emu, uint64_t deadline, gb_stop_reason_e *stop_reason);
+
 gbstatus_e gb_emu_init(gb_emu_t *gb_emu)
 {
     gbstatus_e status = GBSTATUS_OK;
@@ -9,22 +19,37 @@ gbstatus_e gb_emu_init(gb_emu_t *gb_emu)
 
     gb_t *gb = &gb_emu->gb;
 
+    // Peripherals register their I/O handlers in the MMU, so it goes first
+    status = mmu_init(&gb->mmu, gb);
+    if (status != GBSTATUS_OK)
+        goto error_handler0;
+
     cpu_init   (&gb->cpu      , gb);
     int_init   (&gb->intr_ctrl, gb);
     timer_init (&gb->timer    , gb);
     joypad_init(&gb->joypad   , gb);
 
-    status = mmu_init(&gb->mmu, gb);
-    if (status != GBSTATUS_OK)
-        goto error_handler0;
-
     status = ppu_init(&gb->ppu, gb);
     if (status != GBSTATUS_OK)
         goto error_handler1;
 
-    gb_emu->cart_inserted = false;
+    apu_init(&gb->apu, gb);
+
+    scheduler_init(&gb->scheduler, gb);
+
+    status = block_cache_init(&gb->block_cache, gb);
+    if (status != GBSTATUS_OK)
+        goto error_handler2;
+
+    gb_emu->cart_inserted  = false;
+    gb_emu->frameskip_max  = 0;
+    gb_emu->frames_skipped = 0;
+    gb_emu->frame_lag_us   = 0;
     return GBSTATUS_OK;
 
+error_handler2:
+    ppu_deinit(&gb->ppu);
+
 error_handler1:
     mmu_deinit(&gb->mmu);
 
@@ -53,6 +78,64 @@ void gb_emu_grab_frame(gb_emu_t *gb_emu)
     gb_emu->gb.ppu.new_frame_ready = false;
 }
 
+void gb_emu_publish_frame(gb_emu_t *gb_emu, gb_frame_queue_t *queue)
+{
+    assert(gb_emu != NULL);
+    assert(queue  != NULL);
+
+    gb_compositor_output_t *output = &gb_emu->gb.ppu.compositor.output;
+
+    if (output->buffer != NULL)
+        frame_queue_publish(queue, output->buffer);
+    else
+        frame_queue_publish(queue, gb_emu->gb.ppu.framebuffer);
+
+    gb_emu->gb.ppu.new_frame_ready = false;
+}
+
+void gb_emu_set_output(gb_emu_t *gb_emu, void *buffer, int stride,
+                       compositor_format_e format, const uint32_t palette[4])
+{
+    assert(gb_emu != NULL);
+
+    gb_ppu_t *ppu = &gb_emu->gb.ppu;
+
+    compositor_set_output(&ppu->compositor, buffer, stride, format, palette);
+
+    // Only changed scanlines are written later, so the new output or palette
+    // gets the whole current frame once
+    for (int y = 0; y < GB_SCREEN_HEIGHT; y++)
+        compositor_output_line(&ppu->compositor, y, &ppu->framebuffer[y * GB_SCREEN_WIDTH]);
+}
+
+bool gb_emu_frame_changed(gb_emu_t *gb_emu)
+{
+    assert(gb_emu != NULL);
+
+    return gb_emu->gb.ppu.frame_changed;
+}
+
+bool gb_emu_screen_blank(gb_emu_t *gb_emu)
+{
+    assert(gb_emu != NULL);
+
+    return gb_emu->gb.ppu.screen_blank;
+}
+
+void gb_emu_set_audio(gb_emu_t *gb_emu, apu_mode_e mode, int sample_rate)
+{
+    assert(gb_emu != NULL);
+
+    apu_set_mode(&gb_emu->gb.apu, mode, sample_rate);
+}
+
+int gb_emu_read_audio(gb_emu_t *gb_emu, int16_t *samples, int max_samples)
+{
+    assert(gb_emu != NULL);
+
+    return apu_read_samples(&gb_emu->gb.apu, samples, max_samples);
+}
+
 const char *gb_emu_game_title_ptr(gb_emu_t *gb_emu)
 {
     assert(gb_emu != NULL);
@@ -96,11 +179,14 @@ void gb_emu_reset(gb_emu_t *gb_emu)
     gb_t *gb = &gb_emu->gb;
 
     cpu_reset(&gb->cpu);
+    block_cache_reset(&gb->block_cache);
     mmu_reset(&gb->mmu);
     ppu_reset(&gb->ppu);
+    apu_reset(&gb->apu);
     int_reset(&gb->intr_ctrl);
     timer_reset(&gb->timer);
     joypad_reset(&gb->joypad);
+    scheduler_reset(&gb->scheduler);
     // MMU resets inserted cartridge
 }
 
@@ -114,6 +200,63 @@ void gb_emu_skip_bootrom(gb_emu_t *gb_emu)
     mmu_skip_bootrom(&gb->mmu);
 }
 
+void gb_emu_set_idle_loop_skip(gb_emu_t *gb_emu, bool enabled)
+{
+    assert(gb_emu != NULL);
+
+    cpu_set_idle_loop_skip(&gb_emu->gb.cpu, enabled);
+}
+
+void gb_emu_set_deferred_render(gb_emu_t *gb_emu, bool enabled)
+{
+    assert(gb_emu != NULL);
+
+    ppu_set_deferred_render(&gb_emu->gb.ppu, enabled);
+}
+
+void gb_emu_set_render_enabled(gb_emu_t *gb_emu, bool enabled)
+{
+    assert(gb_emu != NULL);
+
+    ppu_set_render_enabled(&gb_emu->gb.ppu, enabled);
+}
+
+void gb_emu_set_auto_frameskip(gb_emu_t *gb_emu, int max_skip)
+{
+    assert(gb_emu   != NULL);
+    assert(max_skip >= 0);
+
+    gb_emu->frameskip_max  = max_skip;
+    gb_emu->frames_skipped = 0;
+    gb_emu->frame_lag_us   = 0;
+
+    ppu_set_render_enabled(&gb_emu->gb.ppu, true);
+}
+
+void gb_emu_report_frame_time(gb_emu_t *gb_emu, int frame_time_us)
+{
+    assert(gb_emu != NULL);
+
+    if (gb_emu->frameskip_max == 0)
+        return;
+
+    // Lag builds up while frames take longer than on the real hardware
+    // and is paid back by cheap skipped frames
+    gb_emu->frame_lag_us += frame_time_us - GB_FRAME_DURATION_US;
+
+    if (gb_emu->frame_lag_us < 0)
+        gb_emu->frame_lag_us = 0;
+
+    // Don't fall behind forever if the host can't keep up even with frameskip
+    if (gb_emu->frame_lag_us > GB_FRAME_DURATION_US * gb_emu->frameskip_max)
+        gb_emu->frame_lag_us = GB_FRAME_DURATION_US * gb_emu->frameskip_max;
+
+    bool skip = gb_emu->frame_lag_us > 0 && gb_emu->frames_skipped < gb_emu->frameskip_max;
+    gb_emu->frames_skipped = skip ? gb_emu->frames_skipped + 1 : 0;
+
+    ppu_set_render_enabled(&gb_emu->gb.ppu, !skip);
+}
+
 gbstatus_e gb_emu_step(gb_emu_t *gb_emu)
 {
     assert(gb_emu != NULL);
@@ -121,6 +264,34 @@ gbstatus_e gb_emu_step(gb_emu_t *gb_emu)
     return cpu_step(&gb_emu->gb.cpu);
 }
 
+gbstatus_e gb_emu_run(gb_emu_t *gb_emu, int max_steps)
+{
+    assert(gb_emu != NULL);
+
+    return cpu_run(&gb_emu->gb.cpu, max_steps);
+}
+
+gbstatus_e gb_emu_run_frame(gb_emu_t *gb_emu, gb_stop_reason_e *stop_reason)
+{
+    assert(gb_emu != NULL);
+
+    return gb_emu_run_until(gb_emu, SCHED_NEVER, stop_reason);
+}
+
+gbstatus_e gb_emu_run_cycles(gb_emu_t *gb_emu, int cycles, gb_stop_reason_e *stop_reason)
+{
+    assert(gb_emu != NULL);
+
+    return gb_emu_run_until(gb_emu, gb_emu->gb.scheduler.now + cycles, stop_reason);
+}
+
+void gb_emu_set_breakpoint(gb_emu_t *gb_emu, int addr)
+{
+    assert(gb_emu != NULL);
+
+    cpu_set_breakpoint(&gb_emu->gb.cpu, addr);
+}
+
 void gb_emu_update_input(gb_emu_t *gb_emu, int new_state)
 {
     assert(gb_emu != NULL);
@@ -137,6 +308,49 @@ void gb_emu_deinit(gb_emu_t *gb_emu)
     if (gb_emu->cart_inserted)
         cart_deinit(&gb_emu->cart);
 
+    block_cache_deinit(&gb->block_cache);
     ppu_deinit(&gb->ppu);
     mmu_deinit(&gb->mmu);
-}
\ No newline at end of file
+}
+
+static gbstatus_e gb_emu_run_until(gb_emu_t *gb_emu, uint64_t deadline, gb_stop_reason_e *stop_reason)
+{
+    gbstatus_e status = GBSTATUS_OK;
+
+    // HALT and idle loops aren't fast-forwarded past the deadline
+    scheduler_set_deadline(&gb_emu->gb.scheduler, deadline);
+
+    cpu_stop_e cpu_stop = CPU_STOP_STEPS;
+    while (cpu_stop == CPU_STOP_STEPS)
+    {
+        status = cpu_run_until(&gb_emu->gb.cpu, INT_MAX, deadline, &cpu_stop);
+        if (status != GBSTATUS_OK)
+            break;
+    }
+
+    scheduler_set_deadline(&gb_emu->gb.scheduler, SCHED_NEVER);
+
+    if (stop_reason != NULL)
+    {
+        switch (cpu_stop)
+        {
+        case CPU_STOP_FRAME:
+            *stop_reason = GB_STOP_FRAME;
+            break;
+
+        case CPU_STOP_CYCLES:
+            *stop_reason = GB_STOP_CYCLES;
+            break;
+
+        case CPU_STOP_BREAKPOINT:
+            *stop_reason = GB_STOP_BREAKPOINT;
+            break;
+
+        default:
+            *stop_reason = GB_STOP_ERROR;
+            break;
+        }
+    }
+
+    return status;
+}
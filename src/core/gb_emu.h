@@ -4,6 +4,31 @@
 #include "gb.h"
 #include "cart.h"
 #include "log.h"
+#include "frame_queue.h"
+
+/// Duration of a Gameboy frame in microseconds, 70224 clock cycles at 4.194304 MHz
+#define GB_FRAME_DURATION_US 16742
+
+/// Gameboy frame rate, 4194304 / 70224
+#define GB_FRAME_RATE 59.7275
+
+/**
+ * Reasons for the emulator to return control
+ */
+typedef enum
+{
+    /// New frame is ready
+    GB_STOP_FRAME,
+
+    /// Cycle budget is used up
+    GB_STOP_CYCLES,
+
+    /// Execution reached the breakpoint
+    GB_STOP_BREAKPOINT,
+
+    /// Emulation error
+    GB_STOP_ERROR
+} gb_stop_reason_e;
 
 /**
  * Gameboy emulator interface
@@ -14,6 +39,13 @@ typedef struct
     
     gb_cart_t   cart;
     bool        cart_inserted;
+
+    /// Maximum number of frames skipped in a row, 0 if auto frameskip is disabled
+    int         frameskip_max;
+    int         frames_skipped;
+
+    /// How much the host is behind the real time
+    int         frame_lag_us;
 } gb_emu_t;
 
 /**
@@ -46,6 +78,73 @@ const bool *gb_emu_frame_ready_ptr(gb_emu_t *gb_emu);
  */
 void gb_emu_grab_frame(gb_emu_t *gb_emu);
 
+/**
+ * Copies the ready frame to the queue for presentation on another thread
+ * and resets PPU frame ready flag. 
+ * The host format output is published if it's set, the PPU framebuffer otherwise.
+ * 
+ * \param gb_emu Emulator instance
+ * \param queue Frame queue, its frame size must match the published frame
+ */
+void gb_emu_publish_frame(gb_emu_t *gb_emu, gb_frame_queue_t *queue);
+
+/**
+ * Makes the PPU write every frame to the caller-provided buffer in the host pixel format
+ * in addition to the PPU framebuffer. Shades are converted through the palette as
+ * scanlines are drawn, so no separate conversion pass is needed. 
+ * The buffer is filled with the current frame right away, after that only changed
+ * scanlines are written, so the caller must not modify it
+ * 
+ * \param gb_emu Emulator instance
+ * \param buffer Output buffer of GB_SCREEN_HEIGHT lines, NULL to disable the output
+ * \param stride Distance between lines in bytes
+ * \param format Pixel format
+ * \param palette Host colors of the four shades, from the lightest to the darkest
+ */
+void gb_emu_set_output(gb_emu_t *gb_emu, void *buffer, int stride,
+                       compositor_format_e format, const uint32_t palette[4]);
+
+/**
+ * Checks whether the ready frame differs from the previous one. 
+ * Frontends may skip presenting unchanged frames, and should skip all presentation 
+ * work while gb_emu_screen_blank is true and the frame is unchanged
+ * 
+ * \param gb_emu Emulator instance
+ * \return True if the frame has changed
+ */
+bool gb_emu_frame_changed(gb_emu_t *gb_emu);
+
+/**
+ * Checks whether the LCD is off and its blank frame was already produced.
+ * Such frames are always reported as unchanged and nothing is drawn for them,
+ * so frontends should skip all presentation work (conversion, upload, vsync) 
+ * and keep showing the previous frame until the screen changes
+ * 
+ * \param gb_emu Emulator instance
+ * \return True if the screen stays blank
+ */
+bool gb_emu_screen_blank(gb_emu_t *gb_emu);
+
+/**
+ * Sets up sound emulation. Sound is synthesized at APU_DEFAULT_SAMPLE_RATE by default
+ * 
+ * \param gb_emu Emulator instance
+ * \param mode Off (registers only), low-rate synthesis resampled to the output rate or full-rate synthesis
+ * \param sample_rate Output sample rate in Hz
+ */
+void gb_emu_set_audio(gb_emu_t *gb_emu, apu_mode_e mode, int sample_rate);
+
+/**
+ * Takes the sound produced since the previous call. 
+ * Samples are interleaved stereo at the output sample rate
+ * 
+ * \param gb_emu Emulator instance
+ * \param samples Buffer for samples
+ * \param max_samples Buffer size in stereo samples
+ * \return Number of stereo samples written
+ */
+int gb_emu_read_audio(gb_emu_t *gb_emu, int16_t *samples, int max_samples);
+
 /**
  * Returns pointer to the game title or NULL if no ROM loaded
  * 
@@ -84,6 +183,51 @@ void gb_emu_reset(gb_emu_t *gb_emu);
  */
 void gb_emu_skip_bootrom(gb_emu_t *gb_emu);
 
+/**
+ * Enables or disables fast-forwarding of idle polling loops
+ * 
+ * \param gb_emu Emulator instance
+ * \param enabled True to enable
+ */
+void gb_emu_set_idle_loop_skip(gb_emu_t *gb_emu, bool enabled);
+
+/**
+ * Enables or disables deferred rendering.
+ * When enabled, scanlines are recorded during emulation and drawn all at once
+ * when the frame is complete.
+ * 
+ * \param gb_emu Emulator instance
+ * \param enabled True to enable
+ */
+void gb_emu_set_deferred_render(gb_emu_t *gb_emu, bool enabled);
+
+/**
+ * Enables or disables pixel generation starting from the next frame.
+ * Emulation is not affected, the framebuffer just keeps the last rendered frame
+ * 
+ * \param gb_emu Emulator instance
+ * \param enabled True to enable
+ */
+void gb_emu_set_render_enabled(gb_emu_t *gb_emu, bool enabled);
+
+/**
+ * Sets up automatic frameskip. Frames are skipped while the host is slower 
+ * than the real hardware according to gb_emu_report_frame_time
+ * 
+ * \param gb_emu Emulator instance
+ * \param max_skip Maximum number of frames skipped in a row, 0 to disable frameskip
+ */
+void gb_emu_set_auto_frameskip(gb_emu_t *gb_emu, int max_skip);
+
+/**
+ * Feeds the host frame time to the auto frameskip. 
+ * Should be called once per frame
+ * 
+ * \param gb_emu Emulator instance
+ * \param frame_time_us Host time spent on the last frame in microseconds
+ */
+void gb_emu_report_frame_time(gb_emu_t *gb_emu, int frame_time_us);
+
 /**
  * Takes one step of emulation
  * 
@@ -91,6 +235,43 @@ void gb_emu_skip_bootrom(gb_emu_t *gb_emu);
  */
 gbstatus_e gb_emu_step(gb_emu_t *gb_emu);
 
+/**
+ * Takes a batch of emulation steps. 
+ * Stops earlier if a new frame is ready.
+ * 
+ * \param gb_emu Emulator instance
+ * \param max_steps Maximum number of steps to take
+ */
+gbstatus_e gb_emu_run(gb_emu_t *gb_emu, int max_steps);
+
+/**
+ * Runs the emulation until a new frame is ready. 
+ * The previous frame must be grabbed before.
+ * 
+ * \param gb_emu Emulator instance
+ * \param stop_reason Receives the reason to stop, may be NULL
+ */
+gbstatus_e gb_emu_run_frame(gb_emu_t *gb_emu, gb_stop_reason_e *stop_reason);
+
+/**
+ * Runs the emulation for the given number of clock cycles. 
+ * Stops at the first instruction boundary after the budget is used up,
+ * or earlier if a new frame is ready.
+ * 
+ * \param gb_emu Emulator instance
+ * \param cycles Cycle budget
+ * \param stop_reason Receives the reason to stop, may be NULL
+ */
+gbstatus_e gb_emu_run_cycles(gb_emu_t *gb_emu, int cycles, gb_stop_reason_e *stop_reason);
+
+/**
+ * Sets the address at which gb_emu_run_frame and gb_emu_run_cycles stop
+ * 
+ * \param gb_emu Emulator instance
+ * \param addr Breakpoint address, -1 to remove the breakpoint
+ */
+void gb_emu_set_breakpoint(gb_emu_t *gb_emu, int addr);
+
 /**
  * Updates state of the joypad
  * 
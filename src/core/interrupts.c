@@ -4,6 +4,9 @@
 
 #define INT_COUNT 5
 
+/// Bits of the existing interrupts
+#define INT_MASK ((1 << INT_COUNT) - 1)
+
 static uint8_t isr_addr[] = 
 {
     0x0040, // VBLANK
@@ -13,12 +16,25 @@ static uint8_t isr_addr[] =
     0x0060  // JOYPAD
 };
 
+MMU_IO_HANDLERS(int_if, gb_int_controller_t)
+
+/**
+ * Recalculates pending interrupts after IE or IF change
+ *
+ * \param ctrl Interrupt controller instance
+ */
+static inline void int_update_pending(gb_int_controller_t *ctrl);
+
 void int_init(gb_int_controller_t *ctrl, gb_t *gb)
 {
     assert(ctrl != NULL);
     assert(gb   != NULL);
 
     ctrl->gb = gb;
+
+    // IE is outside of the I/O area and is handled by the MMU itself
+    mmu_register_io(&gb->mmu, 0xFF0F, int_if_io_read, int_if_io_write, ctrl);
+
     int_reset(ctrl);
 }
 
@@ -28,6 +44,8 @@ void int_reset(gb_int_controller_t *ctrl)
 
     ctrl->reg_ie = 0x00;
     ctrl->reg_if = 0x00;
+
+    int_update_pending(ctrl);
 }
 
 void int_if_write(gb_int_controller_t *ctrl, uint8_t value)
@@ -35,6 +53,7 @@ void int_if_write(gb_int_controller_t *ctrl, uint8_t value)
     assert(ctrl != NULL);
 
     ctrl->reg_if = value;
+    int_update_pending(ctrl);
 }
 
 void int_ie_write(gb_int_controller_t *ctrl, uint8_t value)
@@ -42,6 +61,7 @@ void int_ie_write(gb_int_controller_t *ctrl, uint8_t value)
     assert(ctrl != NULL);
 
     ctrl->reg_ie = value;
+    int_update_pending(ctrl);
 }
 
 uint8_t int_if_read(gb_int_controller_t *ctrl)
@@ -63,23 +83,51 @@ void int_request(gb_int_controller_t *ctrl, interrupt_e intr)
     assert(ctrl != NULL);
 
     ctrl->reg_if |= 1 << intr;
+    int_update_pending(ctrl);
+}
+
+void int_update_serviceable(gb_int_controller_t *ctrl)
+{
+    assert(ctrl != NULL);
+
+    gb_cpu_t *cpu = &ctrl->gb->cpu;
+
+    // Halted CPU is woken up even if interrupts are disabled
+    ctrl->serviceable = cpu->ei_delay != 0 || 
+                        (ctrl->pending != 0 && (cpu->ime || cpu->halted));
 }
 
-void int_step(gb_int_controller_t *ctrl)
+void int_dispatch(gb_int_controller_t *ctrl)
 {
     assert(ctrl != NULL);
 
-    for (interrupt_e intr = 0; intr < INT_COUNT; intr++)
+    gb_cpu_t *cpu = &ctrl->gb->cpu;
+
+    if (ctrl->pending != 0 && (cpu->ime || cpu->halted))
     {
-        int intr_mask = 1 << intr;
+        // Lowest bit has the highest priority
+        interrupt_e intr = __builtin_ctz(ctrl->pending);
 
-        if (ctrl->reg_ie & ctrl->reg_if & intr_mask)
+        if (cpu_irq(cpu, isr_addr[intr]))
         {
-            if (!cpu_irq(&ctrl->gb->cpu, isr_addr[intr]))
-                break;
-
-            ctrl->reg_if &= ~intr_mask;
-            break;
+            ctrl->reg_if &= ~(1 << intr);
+            ctrl->pending = ctrl->reg_ie & ctrl->reg_if & INT_MASK;
         }
     }
-}
\ No newline at end of file
+
+    // EI takes effect with a delay, counted down before the next instruction
+    if (cpu->ei_delay != 0)
+    {
+        cpu->ei_delay--;
+        if (cpu->ei_delay == 0)
+            cpu->ime = true;
+    }
+
+    int_update_serviceable(ctrl);
+}
+
+static inline void int_update_pending(gb_int_controller_t *ctrl)
+{
+    ctrl->pending = ctrl->reg_ie & ctrl->reg_if & INT_MASK;
+    int_update_serviceable(ctrl);
+}
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "gbstatus.h"
 
 // Interrupts are ordered by bit position/priority
@@ -29,6 +30,13 @@ typedef struct
     // Interrupt flags register
     uint8_t reg_if;
 
+    /// IE & IF of the existing interrupts
+    uint8_t pending;
+
+    /// Whether int_step has anything to do: a pending interrupt the CPU can take or wake up from,
+    /// or a delayed EI. Kept up to date for the per-instruction check
+    bool serviceable;
+
     /// Pointer to the parent Gameboy structure
     struct gb *gb;
 } gb_int_controller_t;
@@ -88,11 +96,32 @@ uint8_t int_ie_read(gb_int_controller_t *ctrl);
  */
 void int_request(gb_int_controller_t *ctrl, interrupt_e intr);
 
+/**
+ * Recalculates the serviceable flag. 
+ * Must be called by the CPU after changing IME, EI delay or halt state
+ * 
+ * \param ctrl Interrupt controller instance
+ */
+void int_update_serviceable(gb_int_controller_t *ctrl);
+
+/**
+ * Handles the highest priority pending interrupt and counts down the delayed EI. 
+ * Called by int_step
+ * 
+ * \param ctrl Interrupt controller instance
+ */
+void int_dispatch(gb_int_controller_t *ctrl);
+
 /**
  * Makes one step of the interrupt controller logic
  * 
  * \param ctrl Interrupt controller instance
  */
-void int_step(gb_int_controller_t *ctrl);
+static inline void int_step(gb_int_controller_t *ctrl)
+{
+    // Nothing can be serviced most of the time
+    if (ctrl->serviceable)
+        int_dispatch(ctrl);
+}
 
 #endif
\ No newline at end of file
@@ -5,6 +5,8 @@
 /// Constructs correct JOYP value from P14, P15 and joypad state
 static void joypad_update_reg(gb_joypad_t *joypad);
 
+MMU_IO_HANDLERS(joypad_joyp, gb_joypad_t)
+
 void joypad_init(gb_joypad_t *joypad, struct gb *gb)
 {
     assert(joypad != NULL);
@@ -12,6 +14,8 @@ void joypad_init(gb_joypad_t *joypad, struct gb *gb)
 
     joypad->gb = gb;
 
+    mmu_register_io(&gb->mmu, 0xFF00, joypad_joyp_io_read, joypad_joyp_io_write, joypad);
+
     joypad_reset(joypad);
 }
 
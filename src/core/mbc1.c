@@ -15,6 +15,13 @@ typedef struct
     bool second_mode;
 } mbc1_state_t;
 
+/**
+ * Updates the mapped RAM bank and notifies the listener
+ * 
+ * \param cart Cartridge instance
+ */
+static void mbc1_update_map(gb_cart_t *cart);
+
 gbstatus_e mbc1_init(gb_cart_t *cart)
 {
     gbstatus_e status = GBSTATUS_OK;
@@ -40,6 +47,7 @@ void mbc1_reset(gb_cart_t *cart)
     state->second_mode = false;
     cart->curr_rom_bank = 1;
     cart->curr_ram_bank = 0;
+    mbc1_update_map(cart);
 }
 
 uint8_t mbc1_read(gb_cart_t *cart, uint16_t addr)
@@ -98,6 +106,7 @@ void mbc1_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
     case 0x1000:
         // RAM enable
         state->ram_enabled = (byte & 0xF) == 0xA;
+        mbc1_update_map(cart);
         break;
 
     case 0x2000:
@@ -128,6 +137,7 @@ void mbc1_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
             break;
         }
 
+        mbc1_update_map(cart);
         break;
 
     case 0x4000:
@@ -159,11 +169,14 @@ void mbc1_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
             default:
                 break;
             }
+
+            mbc1_update_map(cart);
         }
         else
         {
             cart->curr_ram_bank = byte;
             cart->curr_ram_bank %= cart->ram_size;
+            mbc1_update_map(cart);
         }
 
         break;
@@ -172,6 +185,7 @@ void mbc1_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
     case 0x7000:
         // Mode switching
         state->second_mode = byte & 0x1;
+        mbc1_update_map(cart);
         break;
 
     case 0xA000:
@@ -197,4 +211,18 @@ void mbc1_deinit(gb_cart_t *cart)
     assert(cart != NULL);
     
     free(cart->mbc_state);
+}
+
+static void mbc1_update_map(gb_cart_t *cart)
+{
+    mbc1_state_t *state = (mbc1_state_t*)cart->mbc_state;
+
+    if (!state->ram_enabled)
+        cart->mapped_ram = NULL;
+    else if (state->second_mode)
+        cart->mapped_ram = cart->ram;
+    else
+        cart->mapped_ram = cart->ram + cart->curr_ram_bank * SRAM_BANK_SIZE;
+
+    cart_map_changed(cart);
 }
\ No newline at end of file
@@ -35,6 +35,9 @@ void mbc2_reset(gb_cart_t *cart)
     mbc2_state_t *state = (mbc2_state_t*)cart->mbc_state;
     state->ram_enabled = false;
     cart->curr_rom_bank = 1;
+
+    // Built-in RAM is mirrored, so it is always accessed through mbc2_read/mbc2_write
+    cart->mapped_ram = NULL;
 }
 
 uint8_t mbc2_read(gb_cart_t *cart, uint16_t addr)
@@ -98,6 +101,8 @@ void mbc2_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
             
             if (cart->curr_rom_bank == 0)
                 cart->curr_rom_bank = 1;
+
+            cart_map_changed(cart);
         }
         else // 8th bit is clear
         {
@@ -13,6 +13,13 @@ typedef struct
     bool ram_enabled;
 } mbc5_state_t;
 
+/**
+ * Updates the mapped RAM bank and notifies the listener
+ * 
+ * \param cart Cartridge instance
+ */
+static void mbc5_update_map(gb_cart_t *cart);
+
 gbstatus_e mbc5_init(gb_cart_t *cart)
 {
     gbstatus_e status = GBSTATUS_OK;
@@ -37,6 +44,7 @@ void mbc5_reset(gb_cart_t *cart)
     state->ram_enabled = false;
     cart->curr_rom_bank = 1;
     cart->curr_ram_bank = 0;
+    mbc5_update_map(cart);
 }
 
 uint8_t mbc5_read(gb_cart_t *cart, uint16_t addr)
@@ -92,6 +100,7 @@ void mbc5_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
     case 0x1000:
         // RAM enable
         state->ram_enabled = (byte & 0xF) == 0xA;
+        mbc5_update_map(cart);
         break;
 
     case 0x2000:
@@ -99,6 +108,7 @@ void mbc5_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
         cart->curr_rom_bank = (cart->curr_rom_bank & (~0xFF)) | (byte & 0xFF);
         cart->curr_rom_bank %= cart->rom_size;
 
+        mbc5_update_map(cart);
         break;
 
     case 0x3000:
@@ -106,6 +116,7 @@ void mbc5_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
         cart->curr_rom_bank = (cart->curr_rom_bank & (~0x100)) | ((byte & 0x1) << 8);
         cart->curr_rom_bank %= cart->rom_size;
 
+        mbc5_update_map(cart);
         break;
 
     case 0x4000:
@@ -114,6 +125,17 @@ void mbc5_write(struct gb_cart *cart, uint16_t addr, uint8_t byte)
         cart->curr_ram_bank = byte;
         cart->curr_ram_bank %= cart->ram_size;
 
+        mbc5_update_map(cart);
+        break;
+
+    case 0xA000:
+    case 0xB000:
+        // External RAM
+        if (state->ram_enabled)
+        {
+            int offset = cart->curr_ram_bank * SRAM_BANK_SIZE;
+            cart->ram[offset + addr - 0xA000] = byte;
+        }
         break;
 
     default:
@@ -126,4 +148,16 @@ void mbc5_deinit(gb_cart_t *cart)
     assert(cart != NULL);
     
     free(cart->mbc_state);
+}
+
+static void mbc5_update_map(gb_cart_t *cart)
+{
+    mbc5_state_t *state = (mbc5_state_t*)cart->mbc_state;
+
+    if (state->ram_enabled)
+        cart->mapped_ram = cart->ram + cart->curr_ram_bank * SRAM_BANK_SIZE;
+    else
+        cart->mapped_ram = NULL;
+
+    cart_map_changed(cart);
 }
\ No newline at end of file
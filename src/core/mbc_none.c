@@ -12,6 +12,8 @@ gbstatus_e mbc_none_init(gb_cart_t *cart)
 void mbc_none_reset(gb_cart_t *cart)
 {
     assert(cart != NULL);
+
+    cart->mapped_ram = cart->ram;
 }
 
 uint8_t mbc_none_read(gb_cart_t *cart, uint16_t addr)
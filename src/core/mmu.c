@@ -32,6 +32,27 @@ static uint8_t gb_bootrom[] =
     0xF5,0x06,0x19,0x78,0x86,0x23,0x05,0x20,0xFB,0x86,0x20,0xFE,0x3E,0x01,0xE0,0x50
 };
 
+/**
+ * Handles bank switches of the cartridge
+ * 
+ * \param mmu MMU instance
+ */
+static void mmu_cart_map_changed(void *mmu);
+
+/**
+ * Handlers of unmapped I/O registers
+ */
+static uint8_t mmu_io_unmapped_read (void *device);
+static void    mmu_io_unmapped_write(void *device, uint8_t value);
+
+/**
+ * Handles writes to the bootrom mapping register
+ * 
+ * \param mmu MMU instance
+ * \param value Value to write
+ */
+static void mmu_bootrom_io_write(void *mmu, uint8_t value);
+
 gbstatus_e mmu_init(gb_mmu_t *mmu, gb_t *gb)
 {
     gbstatus_e status = GBSTATUS_OK;
@@ -52,8 +73,20 @@ gbstatus_e mmu_init(gb_mmu_t *mmu, gb_t *gb)
     mmu->hram = ram + RAM_SIZE;
     
     mmu->cart = NULL;
-    mmu_reset(mmu);
+    mmu->bootrom_mapped = true;
+
+    // Peripherals aren't initialized yet, so everything goes through
+    // the handlers until the page tables are built by mmu_reset
+    for (int page = 0; page < MMU_PAGE_COUNT; page++)
+    {
+        mmu->read_pages [page] = NULL;
+        mmu->write_pages[page] = NULL;
+    }
 
+    for (int reg = 0; reg < MMU_IO_REG_COUNT; reg++)
+        mmu_register_io(mmu, 0xFF00 + reg, mmu_io_unmapped_read, mmu_io_unmapped_write, NULL);
+
+    mmu_register_io(mmu, 0xFF50, mmu_io_unmapped_read, mmu_bootrom_io_write, mmu);
     return GBSTATUS_OK;
 }
 
@@ -68,6 +101,7 @@ void mmu_reset(gb_mmu_t *mmu)
         cart_reset(mmu->cart);
 
     mmu->bootrom_mapped = true;
+    mmu_update_map(mmu);
 }
 
 void mmu_skip_bootrom(gb_mmu_t *mmu)
@@ -75,6 +109,7 @@ void mmu_skip_bootrom(gb_mmu_t *mmu)
     assert(mmu != NULL);
     
     mmu->bootrom_mapped = false;
+    mmu_update_map(mmu);
 }
 
 void mmu_switch_cart(gb_mmu_t *mmu, struct gb_cart *cart)
@@ -82,10 +117,100 @@ void mmu_switch_cart(gb_mmu_t *mmu, struct gb_cart *cart)
     assert(mmu != NULL);
 
     mmu->cart = cart;
+    if (cart != NULL)
+        cart_set_map_listener(cart, mmu_cart_map_changed, mmu);
+
     mmu_reset(mmu);
 }
 
-uint8_t mmu_read(gb_mmu_t *mmu, uint16_t addr)
+void mmu_register_io(gb_mmu_t *mmu, uint16_t addr, mmu_io_read_func_t read,
+                     mmu_io_write_func_t write, void *device)
+{
+    assert(mmu   != NULL);
+    assert(read  != NULL);
+    assert(write != NULL);
+    assert(addr >= 0xFF00 && addr < 0xFF00 + MMU_IO_REG_COUNT);
+
+    gb_mmu_io_reg_t *reg = &mmu->io_regs[addr - 0xFF00];
+    reg->read   = read;
+    reg->write  = write;
+    reg->device = device;
+}
+
+void mmu_update_map(gb_mmu_t *mmu)
+{
+    assert(mmu != NULL);
+
+    gb_t *gb = mmu->gb;
+    gb_cart_t *cart = mmu->cart;
+
+    // OAM, MMIO and unused areas are always handled by mmu_read_unmapped/mmu_write_unmapped
+    for (int page = 0; page < MMU_PAGE_COUNT; page++)
+    {
+        mmu->read_pages [page] = NULL;
+        mmu->write_pages[page] = NULL;
+    }
+
+    if (cart != NULL)
+    {
+        // ROM writes are MBC commands
+        const uint8_t *rom_bank = cart->rom + cart->curr_rom_bank * ROM_BANK_SIZE;
+        for (int page = 0x00; page < 0x40; page++)
+        {
+            mmu->read_pages[page         ] = cart->rom + page * MMU_PAGE_SIZE;
+            mmu->read_pages[page + 0x40] = rom_bank  + page * MMU_PAGE_SIZE;
+        }
+
+        if (cart->mapped_ram != NULL)
+        {
+            for (int page = 0xA0; page < 0xC0; page++)
+            {
+                mmu->read_pages [page] = cart->mapped_ram + (page - 0xA0) * MMU_PAGE_SIZE;
+                mmu->write_pages[page] = cart->mapped_ram + (page - 0xA0) * MMU_PAGE_SIZE;
+            }
+        }
+    }
+
+    if (mmu->bootrom_mapped)
+        mmu->read_pages[0x00] = gb_bootrom;
+
+    for (int page = 0x80; page < 0xA0; page++)
+        mmu->read_pages[page] = gb->ppu.vram + (page - 0x80) * MMU_PAGE_SIZE;
+
+    // Tile data writes must reach ppu_vram_write to keep the tile cache up to date,
+    // only tile maps are written directly unless the PPU logs every write
+    if (!gb->ppu.deferred_render)
+    {
+        for (int page = 0x98; page < 0xA0; page++)
+            mmu->write_pages[page] = gb->ppu.vram + (page - 0x80) * MMU_PAGE_SIZE;
+    }
+
+    for (int page = 0xC0; page < 0xE0; page++)
+        mmu->read_pages[page] = mmu->ram + (page - 0xC0) * MMU_PAGE_SIZE;
+
+    mmu_update_ram_map(mmu);
+}
+
+void mmu_update_ram_map(gb_mmu_t *mmu)
+{
+    assert(mmu != NULL);
+
+    gb_block_cache_t *cache = &mmu->gb->block_cache;
+
+    for (int page = 0xC0; page < 0xE0; page++)
+    {
+        int first_line = (page - 0xC0) * MMU_PAGE_SIZE / BLOCK_RAM_LINE_SIZE;
+
+        bool has_code = false;
+        for (int line = first_line; line < first_line + MMU_PAGE_SIZE / BLOCK_RAM_LINE_SIZE; line++)
+            has_code |= cache->ram_code_lines[line] != 0;
+
+        // Writes to cached code must reach block_cache_ram_write
+        mmu->write_pages[page] = has_code ? NULL : mmu->ram + (page - 0xC0) * MMU_PAGE_SIZE;
+    }
+}
+
+uint8_t mmu_read_unmapped(gb_mmu_t *mmu, uint16_t addr)
 {
     assert(mmu != NULL);
 
@@ -159,90 +284,24 @@ uint8_t mmu_read(gb_mmu_t *mmu, uint16_t addr)
             return ppu_oam_read(&gb->ppu, addr);
 
         case 0xF00:
-            switch (addr & 0xFF)
+            if (addr < 0xFF00 + MMU_IO_REG_COUNT)
             {
-            case 0x0F:
-                // IF (interrupt controller)
-                return int_if_read(&gb->intr_ctrl);
+                // Registers must reflect the current state of peripherals
+                scheduler_sync(&gb->scheduler);
+
+                gb_mmu_io_reg_t *reg = &mmu->io_regs[addr - 0xFF00];
+                return reg->read(reg->device);
+            }
 
-            case 0xFF:
+            if (addr == 0xFFFF)
+            {
                 // IE (interrupt controller)
                 return int_ie_read(&gb->intr_ctrl);
-
-            case 0x00:
-                // JOYP (Joypad)
-                return joypad_joyp_read(&gb->joypad);
-
-            case 0x04:
-                // DIV (timer)
-                return timer_div_read(&gb->timer);
-
-            case 0x05:
-                // TIMA (timer)
-                return timer_tima_read(&gb->timer);
-
-            case 0x06:
-                // TMA (timer)
-                return timer_tma_read(&gb->timer);
-
-            case 0x07:
-                // TAC (timer)
-                return timer_tac_read(&gb->timer);
-
-            case 0x40:
-                // LCDC (PPU)
-                return ppu_lcdc_read(&gb->ppu);
-
-            case 0x41:
-                // STAT (PPU)
-                return ppu_stat_read(&gb->ppu);
-
-            case 0x42:
-                // SCY (PPU)
-                return ppu_scy_read(&gb->ppu);
-            case 0x43:
-                // SCX (PPU)
-                return ppu_scx_read(&gb->ppu);
-
-            case 0x44:
-                // LY (PPU)
-                return ppu_ly_read(&gb->ppu);
-
-            case 0x45:
-                // LYC (PPU)
-                return ppu_lyc_read(&gb->ppu);
-
-            case 0x47:
-                // BGP (PPU)
-                return ppu_bgp_read(&gb->ppu);
-
-            case 0x48:
-                // OBP0 (PPU)
-                return ppu_obp0_read(&gb->ppu);
-
-            case 0x49:
-                // OBP1 (PPU)
-                return ppu_obp1_read(&gb->ppu);
-
-            case 0x4A:
-                // WY (PPU)
-                return ppu_wy_read(&gb->ppu);
-
-            case 0x4B:
-                // WX (PPU)
-                return ppu_wx_read(&gb->ppu);
-
-            case 0x46:
-                // DMA (PPU)
-                return ppu_dma_read(&gb->ppu);
-
-            default:
-                if (addr >= 0xFF80 && addr < 0xFFFF)
-                    return mmu->hram[addr - 0xFF80];
-                else
-                    return 0xFF;
             }
 
+            // HRAM
+            return mmu->hram[addr - 0xFF80];
+
         default:
             return 0xFF;
         }
@@ -252,7 +311,7 @@ uint8_t mmu_read(gb_mmu_t *mmu, uint16_t addr)
     }
 }
 
-void mmu_write(gb_mmu_t *mmu, uint16_t addr, uint8_t byte)
+void mmu_write_unmapped(gb_mmu_t *mmu, uint16_t addr, uint8_t byte)
 {
     assert(mmu != NULL);
 
@@ -284,6 +343,7 @@ void mmu_write(gb_mmu_t *mmu, uint16_t addr, uint8_t byte)
     case 0xD000:
         // Internal RAM
         mmu->ram[addr - 0xC000] = byte;
+        block_cache_ram_write(&gb->block_cache, addr);
         break;
     
     case 0xE000:
@@ -320,113 +380,27 @@ void mmu_write(gb_mmu_t *mmu, uint16_t addr, uint8_t byte)
             break;
 
         case 0xF00:
-            switch (addr & 0xFF)
+            if (addr < 0xFF00 + MMU_IO_REG_COUNT)
             {
-            case 0x0F:
-                // IF (interrupt controller)
-                int_if_write(&gb->intr_ctrl, byte);
-                break;
+                // Peripherals must be up to date before their state is changed
+                scheduler_sync(&gb->scheduler);
 
-            case 0xFF:
+                gb_mmu_io_reg_t *reg = &mmu->io_regs[addr - 0xFF00];
+                reg->write(reg->device, byte);
+
+                // The write might have moved pending events
+                scheduler_reschedule(&gb->scheduler);
+            }
+            else if (addr == 0xFFFF)
+            {
                 // IE (interrupt controller)
                 int_ie_write(&gb->intr_ctrl, byte);
-                break;
-
-            case 0x00:
-                // JOYP (Joypad)
-                joypad_joyp_write(&gb->joypad, byte);
-                break;
-
-            case 0x04:
-                // DIV (timer)
-                timer_div_write(&gb->timer, byte);
-                break;
-
-            case 0x05:
-                // TIMA (timer)
-                timer_tima_write(&gb->timer, byte);
-                break;
-
-            case 0x06:
-                // TMA (timer)
-                timer_tma_write(&gb->timer, byte);
-                break;
-
-            case 0x07:
-                // TAC (timer)
-                timer_tac_write(&gb->timer, byte);
-                break;
-
-            case 0x40:
-                // LCDC (PPU)
-                ppu_lcdc_write(&gb->ppu, byte);
-                break;
-
-            case 0x41:
-                // STAT (PPU)
-                ppu_stat_write(&gb->ppu, byte);
-                break;
-
-            case 0x42:
-                // SCY (PPU)
-                ppu_scy_write(&gb->ppu, byte);
-                break;
-
-            case 0x43:
-                // SCX (PPU)
-                ppu_scx_write(&gb->ppu, byte);
-                break;
-
-            case 0x44:
-                // LY (PPU)
-                ppu_ly_write(&gb->ppu, byte);
-                break;
-
-            case 0x45:
-                // LYC (PPU)
-                ppu_lyc_write(&gb->ppu, byte);
-                break;
-
-            case 0x46:
-                // DMA (PPU)
-                ppu_dma_write(&gb->ppu, byte);
-                break;
-
-            case 0x47:
-                // BGP (PPU)
-                ppu_bgp_write(&gb->ppu, byte);
-                break;
-
-            case 0x48:
-                // OBP0 (PPU)
-                ppu_obp0_write(&gb->ppu, byte);
-                break;
-
-            case 0x49:
-                // OBP1 (PPU)
-                ppu_obp1_write(&gb->ppu, byte);
-                break;
-
-            case 0x4A:
-                // WY (PPU)
-                ppu_wy_write(&gb->ppu, byte);
-                break;
-
-            case 0x4B:
-                // WX (PPU)
-                ppu_wx_write(&gb->ppu, byte);
-                break;
-
-            case 0x50:
-                // Bootrom mapping
-                mmu->bootrom_mapped = false;
-                break;
-
-            default:
-                if (addr >= 0xFF80 && addr < 0xFFFF)
-                    mmu->hram[addr - 0xFF80] = byte;
-                
-                break;
+            }
+            else
+            {
+                // HRAM
+                mmu->hram[addr - 0xFF80] = byte;
+                block_cache_ram_write(&gb->block_cache, addr);
             }
 
             break;
@@ -442,4 +416,33 @@ void mmu_deinit(gb_mmu_t *mmu)
 
     free(mmu->ram);
     // HRAM is in the same block!
+}
+
+static void mmu_cart_map_changed(void *mmu)
+{
+    gb_t *gb = ((gb_mmu_t*)mmu)->gb;
+
+    mmu_update_map((gb_mmu_t*)mmu);
+    block_cache_map_changed(&gb->block_cache);
+}
+
+static uint8_t mmu_io_unmapped_read(void *device)
+{
+    (void)device;
+
+    return 0xFF;
+}
+
+static void mmu_io_unmapped_write(void *device, uint8_t value)
+{
+    (void)device;
+    (void)value;
+}
+
+static void mmu_bootrom_io_write(void *mmu, uint8_t value)
+{
+    (void)value;
+
+    ((gb_mmu_t*)mmu)->bootrom_mapped = false;
+    mmu_update_map((gb_mmu_t*)mmu);
 }
\ No newline at end of file
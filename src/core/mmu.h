@@ -8,6 +8,44 @@
 struct gb;
 struct gb_cart;
 
+/// Memory is mapped in pages of 256 bytes
+#define MMU_PAGE_SIZE  0x100
+#define MMU_PAGE_COUNT 0x100
+
+/// Number of I/O registers (0xFF00-0xFF7F)
+#define MMU_IO_REG_COUNT 0x80
+
+typedef uint8_t (*mmu_io_read_func_t )(void *device);
+typedef void    (*mmu_io_write_func_t)(void *device, uint8_t value);
+
+/**
+ * Defines MMIO handlers forwarding to the register accessors of a peripheral. 
+ * For example, MMU_IO_HANDLERS(timer_div, gb_timer_t) defines timer_div_io_read
+ * and timer_div_io_write calling timer_div_read and timer_div_write
+ */
+#define MMU_IO_HANDLERS(reg, type)                          \
+    static uint8_t reg##_io_read(void *device)              \
+    {                                                       \
+        return reg##_read((type*)device);                   \
+    }                                                       \
+                                                            \
+    static void reg##_io_write(void *device, uint8_t value) \
+    {                                                       \
+        reg##_write((type*)device, value);                  \
+    }
+
+/**
+ * I/O register handlers
+ */
+typedef struct
+{
+    mmu_io_read_func_t  read;
+    mmu_io_write_func_t write;
+
+    /// Argument passed to the handlers
+    void *device;
+} gb_mmu_io_reg_t;
+
 /**
  * Represents Gameboy memory bus. 
  * Handles RAM, cartridge and passes MMIO requests to peripheral devices. 
@@ -28,6 +66,15 @@ typedef struct gb_mmu
 
     /// First 256 bytes are mapped to the bootrom instead of cartridge after power-on
     bool bootrom_mapped;
+
+    /// Pages which can be read directly, NULL if reads must be handled by the MBC or peripherals
+    const uint8_t *read_pages[MMU_PAGE_COUNT];
+
+    /// Pages which can be written directly, NULL if writes must be handled by the MBC or peripherals
+    uint8_t *write_pages[MMU_PAGE_COUNT];
+
+    /// Handlers of I/O registers, registered by peripherals
+    gb_mmu_io_reg_t io_regs[MMU_IO_REG_COUNT];
 } gb_mmu_t;
 
 /**
@@ -61,6 +108,52 @@ void mmu_skip_bootrom(gb_mmu_t *mmu);
  */
 void mmu_switch_cart(gb_mmu_t *mmu, struct gb_cart *cart);
 
+/**
+ * Sets handlers of the I/O register. Called by peripherals on initialization
+ * 
+ * \param mmu MMU instance
+ * \param addr Register address (0xFF00-0xFF7F)
+ * \param read Read handler
+ * \param write Write handler
+ * \param device Argument passed to the handlers
+ */
+void mmu_register_io(gb_mmu_t *mmu, uint16_t addr, mmu_io_read_func_t read,
+                     mmu_io_write_func_t write, void *device);
+
+/**
+ * Rebuilds the page tables. 
+ * Must be called when the memory map changes (bank switches, bootrom unmapping)
+ * 
+ * \param mmu MMU instance
+ */
+void mmu_update_map(gb_mmu_t *mmu);
+
+/**
+ * Rebuilds the WRAM part of the write page table. 
+ * Must be called when the block cache starts or stops tracking code in WRAM
+ * 
+ * \param mmu MMU instance
+ */
+void mmu_update_ram_map(gb_mmu_t *mmu);
+
+/**
+ * Handles a memory read request which can't be served by the page table
+ * 
+ * \param mmu MMU instance
+ * \param addr Address to read
+ * \return Byte read
+ */
+uint8_t mmu_read_unmapped(gb_mmu_t *mmu, uint16_t addr);
+
+/**
+ * Handles a memory write request which can't be served by the page table
+ * 
+ * \param mmu MMU instance
+ * \param addr Address to write
+ * \param byte Byte to write
+ */
+void mmu_write_unmapped(gb_mmu_t *mmu, uint16_t addr, uint8_t byte);
+
 /**
  * Emulates a memory read request from the CPU
  * 
@@ -68,7 +161,14 @@ void mmu_switch_cart(gb_mmu_t *mmu, struct gb_cart *cart);
  * \param addr Address to read
  * \return Byte read
  */
-uint8_t mmu_read(gb_mmu_t *mmu, uint16_t addr);
+static inline uint8_t mmu_read(gb_mmu_t *mmu, uint16_t addr)
+{
+    const uint8_t *page = mmu->read_pages[addr >> 8];
+    if (page != NULL)
+        return page[addr & 0xFF];
+
+    return mmu_read_unmapped(mmu, addr);
+}
 
 /**
  * Emulates a memory write request from the CPU
@@ -77,7 +177,17 @@ uint8_t mmu_read(gb_mmu_t *mmu, uint16_t addr);
  * \param addr Address to write
  * \param byte Byte to write
  */
-void mmu_write(gb_mmu_t *mmu, uint16_t addr, uint8_t byte);
+static inline void mmu_write(gb_mmu_t *mmu, uint16_t addr, uint8_t byte)
+{
+    uint8_t *page = mmu->write_pages[addr >> 8];
+    if (page != NULL)
+    {
+        page[addr & 0xFF] = byte;
+        return;
+    }
+
+    mmu_write_unmapped(mmu, addr, byte);
+}
 
 /**
  * Deinitializes the instance of the MMU
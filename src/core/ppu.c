@@ -13,6 +13,10 @@
 
 #define OAM_ENTRY_SIZE 0x4
 
+/// Tile data area (0x8000-0x97FF) holds 384 tiles, 16 bytes each
+#define TILE_COUNT     384
+#define TILE_DATA_SIZE 16
+
 #define LCDC_BG_WIN_ENABLE_BIT   0
 #define LCDC_OBJ_ENABLE_BIT      1
 #define LCDC_OBJ_SIZE_BIT        2
@@ -74,20 +78,55 @@
 #define SET_BIT(var, bit, val) (var = ((var) & (~(1 << (bit)))) | (((val) & 0x1) << (bit)))
 #define GET_BIT(val, bit) (((val) >> (bit)) & 0x1)
 
-#define GET_TILE_PIXEL(addr, y_offs, x_offs)                               \
-(  ((ppu->vram[(addr) + 2 * (y_offs)    ] >> (7 - (x_offs))) & 0x1) |      \
-  (((ppu->vram[(addr) + 2 * (y_offs) + 1] >> (7 - (x_offs))) & 0x1) << 1))
-
 static void ppu_handle_lyc(gb_ppu_t *ppu);
 
-static void ppu_render_scanline    (gb_ppu_t *ppu);
-static void ppu_render_bg_scanline (gb_ppu_t *ppu);
-static void ppu_render_win_scanline(gb_ppu_t *ppu);
-static void ppu_render_obj_scanline(gb_ppu_t *ppu);
+/// Decodes one row of tile data to the tile cache
+static void ppu_decode_tile_row(const uint8_t *vram, uint8_t *tile_cache, int row_index);
+
+/// Returns decoded row of BG/Window tile according to the addressing mode
+static const uint8_t *ppu_bg_tile_row(const uint8_t *tile_cache, uint8_t lcdc, uint8_t tile_id, int tile_offs_y);
+
+/// Records the register state the current scanline is rendered with
+static void ppu_capture_scanline(gb_ppu_t *ppu, ppu_line_state_t *line);
+
+/// Advances the window line counter if the window is drawn on the current scanline
+/// and returns the window line to draw, -1 otherwise
+static int ppu_next_window_line(gb_ppu_t *ppu);
+
+/// Renders recorded scanlines and catches up the deferred renderer with VRAM
+static void ppu_flush_deferred(gb_ppu_t *ppu);
+
+/// Applies logged VRAM writes to the deferred renderer copy of VRAM
+static void ppu_replay_vram_log(gb_ppu_t *ppu, int from, int to);
+
+static void ppu_render_scanline    (gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                    const uint8_t *vram, const uint8_t *tile_cache);
+static void ppu_render_bg_scanline (gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                    const uint8_t *vram, const uint8_t *tile_cache);
+static void ppu_render_win_scanline(gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                    const uint8_t *vram, const uint8_t *tile_cache);
+static void ppu_render_obj_scanline(gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                    const uint8_t *tile_cache);
 
 /// Determines which sprites will be displayed on the current line
 static void ppu_search_obj(gb_ppu_t *ppu);
 
+/// Distributes sprites over the scanlines they are visible on
+static void ppu_build_sprite_buckets(gb_ppu_t *ppu, int obj_height);
+
+MMU_IO_HANDLERS(ppu_lcdc, gb_ppu_t)
+MMU_IO_HANDLERS(ppu_stat, gb_ppu_t)
+MMU_IO_HANDLERS(ppu_scy , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_scx , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_ly  , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_lyc , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_dma , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_bgp , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_obp0, gb_ppu_t)
+MMU_IO_HANDLERS(ppu_obp1, gb_ppu_t)
+MMU_IO_HANDLERS(ppu_wy  , gb_ppu_t)
+MMU_IO_HANDLERS(ppu_wx  , gb_ppu_t)
+
 
 gbstatus_e ppu_init(gb_ppu_t *ppu, struct gb *gb)
 {
@@ -126,9 +165,76 @@ gbstatus_e ppu_init(gb_ppu_t *ppu, struct gb *gb)
         goto error_handler3;
     }
 
+    ppu->tile_cache = calloc(TILE_COUNT * TILE_HEIGHT * TILE_WIDTH, sizeof(uint8_t));
+    if (ppu->tile_cache == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        goto error_handler4;
+    }
+
+    ppu->line_log = calloc(GB_SCREEN_HEIGHT, sizeof(ppu_line_state_t));
+    if (ppu->line_log == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        goto error_handler5;
+    }
+
+    ppu->vram_log = calloc(PPU_VRAM_LOG_SIZE, sizeof(ppu_vram_write_t));
+    if (ppu->vram_log == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        goto error_handler6;
+    }
+
+    ppu->render_vram = calloc(VRAM_SIZE, sizeof(uint8_t));
+    if (ppu->render_vram == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        goto error_handler7;
+    }
+
+    ppu->render_tile_cache = calloc(TILE_COUNT * TILE_HEIGHT * TILE_WIDTH, sizeof(uint8_t));
+    if (ppu->render_tile_cache == NULL)
+    {
+        GBSTATUS(GBSTATUS_BAD_ALLOC, "unable to allocate memory");
+        goto error_handler8;
+    }
+
+    ppu->deferred_render = false;
+    ppu->render_enabled  = true;
+    compositor_init(&ppu->compositor);
+
+    mmu_register_io(&gb->mmu, 0xFF40, ppu_lcdc_io_read, ppu_lcdc_io_write, ppu);
+    mmu_register_io(&gb->mmu, 0xFF41, ppu_stat_io_read, ppu_stat_io_write, ppu);
+    mmu_register_io(&gb->mmu, 0xFF42, ppu_scy_io_read , ppu_scy_io_write , ppu);
+    mmu_register_io(&gb->mmu, 0xFF43, ppu_scx_io_read , ppu_scx_io_write , ppu);
+    mmu_register_io(&gb->mmu, 0xFF44, ppu_ly_io_read  , ppu_ly_io_write  , ppu);
+    mmu_register_io(&gb->mmu, 0xFF45, ppu_lyc_io_read , ppu_lyc_io_write , ppu);
+    mmu_register_io(&gb->mmu, 0xFF46, ppu_dma_io_read , ppu_dma_io_write , ppu);
+    mmu_register_io(&gb->mmu, 0xFF47, ppu_bgp_io_read , ppu_bgp_io_write , ppu);
+    mmu_register_io(&gb->mmu, 0xFF48, ppu_obp0_io_read, ppu_obp0_io_write, ppu);
+    mmu_register_io(&gb->mmu, 0xFF49, ppu_obp1_io_read, ppu_obp1_io_write, ppu);
+    mmu_register_io(&gb->mmu, 0xFF4A, ppu_wy_io_read  , ppu_wy_io_write  , ppu);
+    mmu_register_io(&gb->mmu, 0xFF4B, ppu_wx_io_read  , ppu_wx_io_write  , ppu);
+
     ppu_reset(ppu);
     return GBSTATUS_OK;
 
+error_handler8:
+    free(ppu->render_vram);
+
+error_handler7:
+    free(ppu->vram_log);
+
+error_handler6:
+    free(ppu->line_log);
+
+error_handler5:
+    free(ppu->tile_cache);
+
+error_handler4:
+    free(ppu->bg_scanline_buffer);
+
 error_handler3:
     free(ppu->framebuffer);
 
@@ -160,6 +266,12 @@ void ppu_reset(gb_ppu_t *ppu)
 
     ppu->lcdc_blocked = false;
     ppu->next_state   = STATE_OBJ_SEARCH;
+    ppu->render_frame = ppu->render_enabled;
+
+    // The first frame is always new for the frontend
+    ppu->frame_changed = true;
+    ppu->lines_changed = true;
+    ppu->screen_blank  = false;
     ppu->clocks_to_next_state = 0;
 
     ppu->window_line = 0;
@@ -167,6 +279,25 @@ void ppu_reset(gb_ppu_t *ppu)
 
     memset(ppu->vram, 0, VRAM_SIZE);
     memset(ppu->oam , 0, OAM_SIZE);
+    ppu->sprite_buckets_dirty = true;
+
+    ppu->dma_active   = false;
+    ppu->dma_source   = 0;
+    ppu->dma_start    = 0;
+    ppu->dma_progress = 0;
+    memset(ppu->tile_cache, 0, TILE_COUNT * TILE_HEIGHT * TILE_WIDTH);
+
+    ppu->line_log_size = 0;
+    ppu->vram_log_size = 0;
+    memset(ppu->render_vram      , 0, VRAM_SIZE);
+    memset(ppu->render_tile_cache, 0, TILE_COUNT * TILE_HEIGHT * TILE_WIDTH);
+}
+
+int ppu_cycles_to_next_state(gb_ppu_t *ppu)
+{
+    assert(ppu != NULL);
+
+    return ppu->clocks_to_next_state - ppu->cycles_counter;
 }
 
 void ppu_update(gb_ppu_t *ppu, int elapsed_cycles)
@@ -189,9 +320,34 @@ void ppu_update(gb_ppu_t *ppu, int elapsed_cycles)
             ppu->reg_ly = 0;
             ppu->clocks_to_next_state = FRAME_DURATION;
 
-            // Clear screen
-            memset(ppu->framebuffer, 0, GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT);
             ppu->new_frame_ready = true;
+
+            if (ppu->screen_blank)
+            {
+                // Blank frame was already published, nothing to redraw.
+                // Logged VRAM writes are replayed with the next drawn frame
+                ppu->frame_changed = false;
+                continue;
+            }
+
+            // Scanlines drawn before turning off must be rendered anyway
+            if (ppu->deferred_render)
+                ppu_flush_deferred(ppu);
+
+            // Clear screen
+            for (int i = 0; i < GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT && !ppu->lines_changed; i++)
+                ppu->lines_changed = ppu->framebuffer[i] != 0;
+
+            if (ppu->lines_changed)
+            {
+                memset(ppu->framebuffer, 0, GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT);
+                for (int y = 0; y < GB_SCREEN_HEIGHT; y++)
+                    compositor_output_line(&ppu->compositor, y, &ppu->framebuffer[y * GB_SCREEN_WIDTH]);
+            }
+
+            ppu->frame_changed = ppu->lines_changed;
+            ppu->lines_changed = false;
+            ppu->screen_blank  = true;
             
             continue;
         }
@@ -224,7 +380,25 @@ void ppu_update(gb_ppu_t *ppu, int elapsed_cycles)
 
         case STATE_HBLANK:
             ppu_search_obj(ppu);
-            ppu_render_scanline(ppu);
+
+            if (!ppu->render_frame)
+            {
+                // Skipped frames still advance the window line counter
+                ppu_next_window_line(ppu);
+            }
+            else if (ppu->deferred_render)
+            {
+                if (ppu->line_log_size == GB_SCREEN_HEIGHT)
+                    ppu_flush_deferred(ppu);
+
+                ppu_capture_scanline(ppu, &ppu->line_log[ppu->line_log_size++]);
+            }
+            else
+            {
+                ppu_line_state_t line;
+                ppu_capture_scanline(ppu, &line);
+                ppu_render_scanline(ppu, &line, ppu->vram, ppu->tile_cache);
+            }
 
             SET_BIT(ppu->reg_stat, STAT_STATE_BIT0, 0);
             SET_BIT(ppu->reg_stat, STAT_STATE_BIT1, 0);
@@ -258,8 +432,13 @@ void ppu_update(gb_ppu_t *ppu, int elapsed_cycles)
                 SET_BIT(ppu->reg_stat, STAT_STATE_BIT1, 0);
 
                 int_request(&gb->intr_ctrl, INT_VBLANK);
+
+                if (ppu->deferred_render)
+                    ppu_flush_deferred(ppu);
                 
                 ppu->new_frame_ready = true;
+                ppu->frame_changed   = ppu->lines_changed;
+                ppu->lines_changed   = false;
             }
 
             ppu_handle_lyc(ppu);
@@ -301,6 +480,7 @@ void ppu_update(gb_ppu_t *ppu, int elapsed_cycles)
 
             ppu->lcdc_blocked = false;
             ppu->window_line  = 0;
+            ppu->render_frame = ppu->render_enabled;
 
             if (ppu->delayed_wy != -1)
             {
@@ -431,6 +611,8 @@ void ppu_lcdc_write(gb_ppu_t *ppu, uint8_t value)
         ppu->cycles_counter = 0;
         ppu->lcdc_blocked = false;
         ppu->reg_ly = 0;
+        ppu->render_frame = ppu->render_enabled;
+        ppu->screen_blank = false;
 
         // set hblank for 80 cycles
         SET_BIT(ppu->reg_stat, STAT_STATE_BIT0, 0);
@@ -526,8 +708,49 @@ void ppu_dma_write(gb_ppu_t *ppu, uint8_t value)
     if (value > 0xDF)
         return;
 
-    for (uint8_t i = 0; i < OAM_SIZE; i++)
-        ppu->oam[i] = mmu_read(&ppu->gb->mmu, (value << 8) | i);
+    // Restarting the transfer keeps already copied bytes
+    ppu_dma_sync(ppu);
+
+    ppu->dma_active   = true;
+    ppu->dma_source   = value << 8;
+    ppu->dma_start    = ppu->gb->scheduler.now;
+    ppu->dma_progress = 0;
+}
+
+void ppu_dma_sync(gb_ppu_t *ppu)
+{
+    assert(ppu != NULL);
+
+    if (!ppu->dma_active)
+        return;
+
+    gb_mmu_t *mmu = &ppu->gb->mmu;
+
+    uint64_t elapsed = ppu->gb->scheduler.now - ppu->dma_start;
+
+    int target = OAM_SIZE;
+    if (elapsed < PPU_DMA_DURATION)
+        target = elapsed / (PPU_DMA_DURATION / OAM_SIZE);
+
+    if (target > ppu->dma_progress)
+    {
+        // The source page can't be remapped during the transfer, as the CPU can't reach MBC
+        const uint8_t *src_page = mmu->read_pages[ppu->dma_source >> 8];
+
+        if (src_page != NULL)
+            memcpy(&ppu->oam[ppu->dma_progress], &src_page[ppu->dma_progress], target - ppu->dma_progress);
+        else
+        {
+            for (int i = ppu->dma_progress; i < target; i++)
+                ppu->oam[i] = mmu_read(mmu, ppu->dma_source | i);
+        }
+
+        ppu->dma_progress = target;
+        ppu->sprite_buckets_dirty = true;
+    }
+
+    if (elapsed >= PPU_DMA_DURATION)
+        ppu->dma_active = false;
 }
 
 void ppu_vram_write(gb_ppu_t *ppu, uint16_t addr, uint8_t byte)
@@ -535,13 +758,32 @@ void ppu_vram_write(gb_ppu_t *ppu, uint16_t addr, uint8_t byte)
     assert(ppu != NULL);
 
     ppu->vram[addr - 0x8000] = byte;
+
+    if (addr - 0x8000 < TILE_COUNT * TILE_DATA_SIZE)
+        ppu_decode_tile_row(ppu->vram, ppu->tile_cache, (addr - 0x8000) / 2);
+
+    if (ppu->deferred_render)
+    {
+        if (ppu->vram_log_size == PPU_VRAM_LOG_SIZE)
+            ppu_flush_deferred(ppu);
+
+        ppu_vram_write_t *write = &ppu->vram_log[ppu->vram_log_size++];
+        write->offset = addr - 0x8000;
+        write->value  = byte;
+    }
 }
 
 void ppu_oam_write(gb_ppu_t *ppu, uint16_t addr, uint8_t byte)
 {
     assert(ppu != NULL);
 
-    ppu->oam[addr - 0xFE00] = byte;
+    uint16_t offset = addr - 0xFE00;
+
+    // Only Y and X coordinates affect the buckets
+    if (offset % OAM_ENTRY_SIZE < 2 && ppu->oam[offset] != byte)
+        ppu->sprite_buckets_dirty = true;
+
+    ppu->oam[offset] = byte;
 }
 
 void ppu_deinit(gb_ppu_t *ppu)
@@ -552,6 +794,40 @@ void ppu_deinit(gb_ppu_t *ppu)
     free(ppu->oam);
     free(ppu->framebuffer);
     free(ppu->bg_scanline_buffer);
+    free(ppu->tile_cache);
+    free(ppu->line_log);
+    free(ppu->vram_log);
+    free(ppu->render_vram);
+    free(ppu->render_tile_cache);
+}
+
+void ppu_set_deferred_render(gb_ppu_t *ppu, bool enabled)
+{
+    assert(ppu != NULL);
+
+    if (enabled == ppu->deferred_render)
+        return;
+
+    if (enabled)
+    {
+        // The deferred renderer starts from the current VRAM
+        memcpy(ppu->render_vram      , ppu->vram      , VRAM_SIZE);
+        memcpy(ppu->render_tile_cache, ppu->tile_cache, TILE_COUNT * TILE_HEIGHT * TILE_WIDTH);
+    }
+    else
+        ppu_flush_deferred(ppu);
+
+    ppu->deferred_render = enabled;
+
+    // All VRAM writes have to be logged in deferred mode
+    mmu_update_map(&ppu->gb->mmu);
+}
+
+void ppu_set_render_enabled(gb_ppu_t *ppu, bool enabled)
+{
+    assert(ppu != NULL);
+
+    ppu->render_enabled = enabled;
 }
 
 static void ppu_handle_lyc(gb_ppu_t *ppu)
@@ -570,130 +846,207 @@ static void ppu_handle_lyc(gb_ppu_t *ppu)
         SET_BIT(ppu->reg_stat, STAT_LYC_FLAG_BIT, 0);
 }
 
-static void ppu_render_scanline(gb_ppu_t *ppu)
+static void ppu_capture_scanline(gb_ppu_t *ppu, ppu_line_state_t *line)
+{
+    line->ly   = ppu->reg_ly;
+    line->lcdc = ppu->reg_lcdc;
+    line->scx  = ppu->reg_scx;
+    line->scy  = ppu->reg_scy;
+    line->wx   = ppu->reg_wx;
+    line->bgp  = ppu->reg_bgp;
+    line->obp0 = ppu->reg_obp0;
+    line->obp1 = ppu->reg_obp1;
+
+    line->window_line = ppu_next_window_line(ppu);
+
+    line->sprite_count = ppu->line_sprite_count;
+    for (int i = 0; i < ppu->line_sprite_count; i++)
+    {
+        uint16_t obj_oam_addr = (ppu->sprite_draw_order[i] & 0xFF) * OAM_ENTRY_SIZE;
+        memcpy(line->sprites[i], &ppu->oam[obj_oam_addr], OAM_ENTRY_SIZE);
+    }
+
+    line->vram_log_pos = ppu->vram_log_size;
+}
+
+static int ppu_next_window_line(gb_ppu_t *ppu)
+{
+    // Window line counter only advances on lines the window is drawn on
+    if (GET_BIT(ppu->reg_lcdc, LCDC_BG_WIN_ENABLE_BIT) &&
+        GET_BIT(ppu->reg_lcdc, LCDC_WIN_ENABLE_BIT) &&
+        ppu->reg_wx < GB_SCREEN_WIDTH + WIN_GLOBAL_X_OFFSET &&
+        ppu->reg_wy < GB_SCREEN_HEIGHT &&
+        ppu->window_line < GB_SCREEN_HEIGHT &&
+        ppu->reg_ly >= ppu->reg_wy)
+    {
+        return ppu->window_line++;
+    }
+
+    return -1;
+}
+
+static void ppu_flush_deferred(gb_ppu_t *ppu)
+{
+    int replayed = 0;
+
+    for (int i = 0; i < ppu->line_log_size; i++)
+    {
+        ppu_line_state_t *line = &ppu->line_log[i];
+
+        // Bring VRAM to the state it had when the scanline was drawn
+        ppu_replay_vram_log(ppu, replayed, line->vram_log_pos);
+        replayed = line->vram_log_pos;
+
+        ppu_render_scanline(ppu, line, ppu->render_vram, ppu->render_tile_cache);
+    }
+
+    ppu_replay_vram_log(ppu, replayed, ppu->vram_log_size);
+
+    ppu->line_log_size = 0;
+    ppu->vram_log_size = 0;
+}
+
+static void ppu_replay_vram_log(gb_ppu_t *ppu, int from, int to)
+{
+    for (int i = from; i < to; i++)
+    {
+        ppu_vram_write_t *write = &ppu->vram_log[i];
+
+        ppu->render_vram[write->offset] = write->value;
+
+        if (write->offset < TILE_COUNT * TILE_DATA_SIZE)
+            ppu_decode_tile_row(ppu->render_vram, ppu->render_tile_cache, write->offset / 2);
+    }
+}
+
+static void ppu_render_scanline(gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                const uint8_t *vram, const uint8_t *tile_cache)
 {
-    if (GET_BIT(ppu->reg_lcdc, LCDC_BG_WIN_ENABLE_BIT))
+    if (GET_BIT(line->lcdc, LCDC_BG_WIN_ENABLE_BIT))
     {
         // Background is enabled, Window can be enabled
 
-        ppu_render_bg_scanline(ppu);
+        ppu_render_bg_scanline(ppu, line, vram, tile_cache);
+
+        if (line->window_line != -1)
+            ppu_render_win_scanline(ppu, line, vram, tile_cache);
 
-        if (GET_BIT(ppu->reg_lcdc, LCDC_WIN_ENABLE_BIT))
-            ppu_render_win_scanline(ppu);
+        ppu->compositor.bg_func(ppu->composed_line, ppu->bg_scanline_buffer, line->bgp);
     }
     else
     {
         // Clear scanline
-        memset(&ppu->framebuffer[ppu->reg_ly * GB_SCREEN_WIDTH], 0, GB_SCREEN_WIDTH);
+        memset(ppu->composed_line, 0, GB_SCREEN_WIDTH);
     }
 
-    if (GET_BIT(ppu->reg_lcdc, LCDC_OBJ_ENABLE_BIT))
-        ppu_render_obj_scanline(ppu);
+    if (GET_BIT(line->lcdc, LCDC_OBJ_ENABLE_BIT))
+        ppu_render_obj_scanline(ppu, line, tile_cache);
+
+    // The framebuffer and the output still hold the line of the previous frame
+    char *fb_line = &ppu->framebuffer[line->ly * GB_SCREEN_WIDTH];
+    if (memcmp(fb_line, ppu->composed_line, GB_SCREEN_WIDTH) != 0)
+    {
+        memcpy(fb_line, ppu->composed_line, GB_SCREEN_WIDTH);
+        compositor_output_line(&ppu->compositor, line->ly, fb_line);
+        ppu->lines_changed = true;
+    }
 }
 
-static void ppu_render_bg_scanline(gb_ppu_t *ppu)
+static void ppu_render_bg_scanline(gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                   const uint8_t *vram, const uint8_t *tile_cache)
 {
-    uint16_t bg_tilemap_addr = GET_BIT(ppu->reg_lcdc, LCDC_BG_TILEMAP_BIT) ? TILEMAP1_ADDR : TILEMAP0_ADDR;
+    uint16_t bg_tilemap_addr = GET_BIT(line->lcdc, LCDC_BG_TILEMAP_BIT) ? TILEMAP1_ADDR : TILEMAP0_ADDR;
 
-    int bg_line = (ppu->reg_scy + ppu->reg_ly) % (BG_HEIGHT * TILE_HEIGHT);
+    int bg_line = (line->scy + line->ly) % (BG_HEIGHT * TILE_HEIGHT);
 
     int bg_tile_row    = bg_line / TILE_HEIGHT;
     int bg_tile_offs_y = bg_line % TILE_HEIGHT;
 
-    for (int x = 0; x < GB_SCREEN_WIDTH; x++)
-    {
-        int bg_col = (ppu->reg_scx + x) % (BG_WIDTH * TILE_WIDTH);
+    const uint8_t *tilemap = &vram[bg_tilemap_addr + bg_tile_row * BG_WIDTH];
 
-        int bg_tile_col    = bg_col / TILE_WIDTH;
+    int bg_col = line->scx;
+    int x = 0;
+
+    while (x < GB_SCREEN_WIDTH)
+    {
+        int bg_tile_col    = (bg_col / TILE_WIDTH) % BG_WIDTH;
         int bg_tile_offs_x = bg_col % TILE_WIDTH;
 
-        uint8_t tile_id = ppu->vram[bg_tilemap_addr + bg_tile_row * BG_WIDTH + bg_tile_col];
+        const uint8_t *tile_row = ppu_bg_tile_row(tile_cache, line->lcdc, tilemap[bg_tile_col], bg_tile_offs_y);
 
-        // two addressing modes
-        uint16_t tiledata_addr = 0;
-        if (GET_BIT(ppu->reg_lcdc, LCDC_BG_WIN_TILEDATA_BIT))
-            tiledata_addr = TILEDATA1_ADDR + tile_id * 16; // one tile takes 16 bytes
-        else
-            tiledata_addr = TILEDATA0_ADDR + (128 + (int8_t)tile_id) * 16;
+        int pixels = TILE_WIDTH - bg_tile_offs_x;
+        if (pixels > GB_SCREEN_WIDTH - x)
+            pixels = GB_SCREEN_WIDTH - x;
 
-        int pixel_pallete_id = GET_TILE_PIXEL(tiledata_addr, bg_tile_offs_y, bg_tile_offs_x);
+        memcpy(&ppu->bg_scanline_buffer[x], &tile_row[bg_tile_offs_x], pixels);
 
-        ppu->bg_scanline_buffer[x] = pixel_pallete_id;
-        ppu->framebuffer[ppu->reg_ly * GB_SCREEN_WIDTH + x] = (ppu->reg_bgp >> (pixel_pallete_id * 2)) & 0x3;  
+        x      += pixels;
+        bg_col += pixels;
     }
 }
 
-static void ppu_render_win_scanline(gb_ppu_t *ppu)
+static void ppu_render_win_scanline(gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                    const uint8_t *vram, const uint8_t *tile_cache)
 {
-    if (ppu->reg_wx < GB_SCREEN_WIDTH + WIN_GLOBAL_X_OFFSET &&
-        ppu->reg_wy < GB_SCREEN_HEIGHT &&
-        ppu->window_line < GB_SCREEN_HEIGHT &&
-        ppu->reg_ly >= ppu->reg_wy)
-    {
-        uint16_t win_tilemap_addr = GET_BIT(ppu->reg_lcdc, LCDC_WIN_TILEMAP_BIT) ? TILEMAP1_ADDR : TILEMAP0_ADDR;
+    uint16_t win_tilemap_addr = GET_BIT(line->lcdc, LCDC_WIN_TILEMAP_BIT) ? TILEMAP1_ADDR : TILEMAP0_ADDR;
 
-        int win_tile_row    = ppu->window_line / TILE_HEIGHT;
-        int win_tile_offs_y = ppu->window_line % TILE_HEIGHT;
+    int win_tile_row    = line->window_line / TILE_HEIGHT;
+    int win_tile_offs_y = line->window_line % TILE_HEIGHT;
 
-        int window_col = 0;
-        if (ppu->reg_wx < WIN_GLOBAL_X_OFFSET)
-            window_col = WIN_GLOBAL_X_OFFSET - ppu->reg_wx;
+    int window_col = 0;
+    if (line->wx < WIN_GLOBAL_X_OFFSET)
+        window_col = WIN_GLOBAL_X_OFFSET - line->wx;
 
-        int win_x_offs = ppu->reg_wx - WIN_GLOBAL_X_OFFSET;
-        if (win_x_offs < 0)
-            win_x_offs = 0;
+    int win_x_offs = line->wx - WIN_GLOBAL_X_OFFSET;
+    if (win_x_offs < 0)
+        win_x_offs = 0;
 
-        for (int x = win_x_offs; x < GB_SCREEN_WIDTH; x++)
-        {
-            int win_tile_col    = window_col / TILE_WIDTH;
-            int win_tile_offs_x = window_col % TILE_WIDTH;
+    const uint8_t *tilemap = &vram[win_tilemap_addr + win_tile_row * BG_WIDTH];
 
-            uint8_t tile_id = ppu->vram[win_tilemap_addr + win_tile_row * BG_WIDTH + win_tile_col];
+    int x = win_x_offs;
+    while (x < GB_SCREEN_WIDTH)
+    {
+        int win_tile_col    = window_col / TILE_WIDTH;
+        int win_tile_offs_x = window_col % TILE_WIDTH;
 
-            // two addressing modes
-            uint16_t tiledata_addr = 0;
-            if (GET_BIT(ppu->reg_lcdc, LCDC_BG_WIN_TILEDATA_BIT))
-                tiledata_addr = TILEDATA1_ADDR + tile_id * 16; // one tile takes 16 bytes
-            else
-                tiledata_addr = TILEDATA0_ADDR + (128 + (int8_t)tile_id) * 16;
+        const uint8_t *tile_row = ppu_bg_tile_row(tile_cache, line->lcdc, tilemap[win_tile_col], win_tile_offs_y);
 
-            int pixel_pallete_id = GET_TILE_PIXEL(tiledata_addr, win_tile_offs_y, win_tile_offs_x);
+        int pixels = TILE_WIDTH - win_tile_offs_x;
+        if (pixels > GB_SCREEN_WIDTH - x)
+            pixels = GB_SCREEN_WIDTH - x;
 
-            ppu->bg_scanline_buffer[x] = pixel_pallete_id;
-            ppu->framebuffer[ppu->reg_ly * GB_SCREEN_WIDTH + x] = (ppu->reg_bgp >> (pixel_pallete_id * 2)) & 0x3;
-        
-            window_col++;
-        }
+        memcpy(&ppu->bg_scanline_buffer[x], &tile_row[win_tile_offs_x], pixels);
 
-        ppu->window_line++;
+        x          += pixels;
+        window_col += pixels;
     }
 }
 
-static void ppu_render_obj_scanline(gb_ppu_t *ppu)
+static void ppu_render_obj_scanline(gb_ppu_t *ppu, const ppu_line_state_t *line,
+                                    const uint8_t *tile_cache)
 {
-    for (int i = 0; i < ppu->line_sprite_count; i++)
-    {        
-        uint16_t obj_oam_addr = (ppu->sprite_draw_order[i] & 0xFF) * OAM_ENTRY_SIZE;
+    char *fb_line = ppu->composed_line;
 
-        int     obj_y_offs = ppu->oam[obj_oam_addr];
-        int     obj_x_offs = ppu->oam[obj_oam_addr + 1];
-        uint8_t tile_id    = ppu->oam[obj_oam_addr + 2];
-        uint8_t flags      = ppu->oam[obj_oam_addr + 3];
+    for (int i = 0; i < line->sprite_count; i++)
+    {
+        int     obj_y_offs = line->sprites[i][0];
+        int     obj_x_offs = line->sprites[i][1];
+        uint8_t tile_id    = line->sprites[i][2];
+        uint8_t flags      = line->sprites[i][3];
 
         // Check sprite for visibility
         if (obj_x_offs == 0 || obj_x_offs >= GB_SCREEN_WIDTH + OBJ_GLOBAL_X_OFFSET)
             continue;
 
-        uint16_t tiledata_addr = TILEDATA1_ADDR + tile_id * 16;
-        uint8_t  obj_pallete   = GET_BIT(flags, OAM_ENTRY_PALLETE_BIT) ? ppu->reg_obp1 : ppu->reg_obp0;
+        uint8_t obj_pallete = GET_BIT(flags, OAM_ENTRY_PALLETE_BIT) ? line->obp1 : line->obp0;
 
-        int obj_height = GET_BIT(ppu->reg_lcdc, LCDC_OBJ_SIZE_BIT) ? OBJ_HEIGHT_1 : OBJ_HEIGHT_0;
+        int obj_height = GET_BIT(line->lcdc, LCDC_OBJ_SIZE_BIT) ? OBJ_HEIGHT_1 : OBJ_HEIGHT_0;
 
         bool flip_x   = GET_BIT(flags, OAM_ENTRY_FLIP_X_BIT);
         bool flip_y   = GET_BIT(flags, OAM_ENTRY_FLIP_Y_BIT);
         bool priority = GET_BIT(flags, OAM_ENTRY_PRIORITY_BIT);
 
-        int obj_line = ppu->reg_ly - (obj_y_offs - OBJ_GLOBAL_Y_OFFSET);
+        int obj_line = line->ly - (obj_y_offs - OBJ_GLOBAL_Y_OFFSET);
 
         int obj_col = 0;
         if (flip_x)
@@ -708,7 +1061,7 @@ static void ppu_render_obj_scanline(gb_ppu_t *ppu)
             if (obj_x_offs < OBJ_GLOBAL_X_OFFSET)
                 obj_col = OBJ_GLOBAL_X_OFFSET - obj_x_offs;
         }
-        
+
         obj_x_offs -= OBJ_GLOBAL_X_OFFSET;
         if (obj_x_offs < 0)
             obj_x_offs = 0;
@@ -716,56 +1069,111 @@ static void ppu_render_obj_scanline(gb_ppu_t *ppu)
         if (flip_y)
             obj_line = obj_height - 1 - obj_line;
 
-        for (int x = obj_x_offs; x < obj_x_offs + OBJ_WIDTH && x < GB_SCREEN_WIDTH; x++)
-        {
-            int pixel_pallete_id = GET_TILE_PIXEL(tiledata_addr, obj_line, obj_col);
+        // Tall sprites continue into the next tile, which is the next 8 rows of the cache
+        const uint8_t *tile_row = &tile_cache[(tile_id * TILE_HEIGHT + obj_line) * TILE_WIDTH];
 
-            if ((priority && ppu->bg_scanline_buffer[x] == 0) || !priority)
-            {
-                if (pixel_pallete_id != 0)
-                    ppu->framebuffer[ppu->reg_ly * GB_SCREEN_WIDTH + x] = (obj_pallete >> (pixel_pallete_id * 2)) & 0x3;
-            }
+        // Mirrored sprites are drawn from the mirrored row left to right as well
+        uint8_t flipped_row[OBJ_WIDTH];
+        if (flip_x)
+        {
+            for (int col = 0; col < OBJ_WIDTH; col++)
+                flipped_row[col] = tile_row[OBJ_WIDTH - 1 - col];
 
-            if (flip_x)
-                obj_col--;
-            else
-                obj_col++;
+            tile_row = flipped_row;
+            obj_col  = OBJ_WIDTH - 1 - obj_col;
         }
+
+        // Sprites clipped by the left edge run out of columns earlier
+        int pixels = OBJ_WIDTH - obj_col;
+        if (pixels > GB_SCREEN_WIDTH - obj_x_offs)
+            pixels = GB_SCREEN_WIDTH - obj_x_offs;
+
+        ppu->compositor.obj_func(&fb_line[obj_x_offs], &ppu->bg_scanline_buffer[obj_x_offs],
+                                 &tile_row[obj_col], pixels, obj_pallete, priority);
     }
 }
 
-static int ppu_draw_order_cmp(const void *a, const void *b)
+static void ppu_decode_tile_row(const uint8_t *vram, uint8_t *tile_cache, int row_index)
+{
+    uint8_t low  = vram[row_index * 2];
+    uint8_t high = vram[row_index * 2 + 1];
+
+    uint8_t *row = &tile_cache[row_index * TILE_WIDTH];
+
+    for (int x = 0; x < TILE_WIDTH; x++)
+        row[x] = ((low >> (7 - x)) & 0x1) | (((high >> (7 - x)) & 0x1) << 1);
+}
+
+static const uint8_t *ppu_bg_tile_row(const uint8_t *tile_cache, uint8_t lcdc, uint8_t tile_id, int tile_offs_y)
 {
-    return *(int*)b - *(int*)a;
+    // two addressing modes
+    int tile_index = 0;
+    if (GET_BIT(lcdc, LCDC_BG_WIN_TILEDATA_BIT))
+        tile_index = TILEDATA1_ADDR / TILE_DATA_SIZE + tile_id;
+    else
+        tile_index = TILEDATA0_ADDR / TILE_DATA_SIZE + 128 + (int8_t)tile_id;
+
+    return &tile_cache[(tile_index * TILE_HEIGHT + tile_offs_y) * TILE_WIDTH];
 }
 
 static void ppu_search_obj(gb_ppu_t *ppu)
 {
-    for (int i = 0; i < MAX_SPRITE_PER_LINE; i++)
-        ppu->sprite_draw_order[i] = -1;
-
-    ppu->line_sprite_count = 0;
+    // PPU sees the partially transferred OAM
+    ppu_dma_sync(ppu);
 
     int obj_height = GET_BIT(ppu->reg_lcdc, LCDC_OBJ_SIZE_BIT) ? OBJ_HEIGHT_1 : OBJ_HEIGHT_0;
 
+    if (ppu->sprite_buckets_dirty || ppu->sprite_buckets_obj_height != obj_height)
+        ppu_build_sprite_buckets(ppu, obj_height);
+
+    ppu->line_sprite_count = ppu->sprite_bucket_sizes[ppu->reg_ly];
+    memcpy(ppu->sprite_draw_order, ppu->sprite_buckets[ppu->reg_ly], ppu->line_sprite_count * sizeof(int));
+}
+
+static void ppu_build_sprite_buckets(gb_ppu_t *ppu, int obj_height)
+{
+    memset(ppu->sprite_bucket_sizes, 0, sizeof(ppu->sprite_bucket_sizes));
+
     // Less x coord - higher priority, less OAM index - higher priority if coords are same
 
-    for (char i = 0; i < OAM_SIZE / OAM_ENTRY_SIZE; i++)
+    for (int i = 0; i < OAM_SIZE / OAM_ENTRY_SIZE; i++)
     {
-        uint8_t obj_y_offs = ppu->oam[OAM_ENTRY_SIZE * i];
-        uint8_t obj_x_offs = ppu->oam[OAM_ENTRY_SIZE * i + 1];
+        int obj_y_offs = ppu->oam[OAM_ENTRY_SIZE * i];
+        int obj_x_offs = ppu->oam[OAM_ENTRY_SIZE * i + 1];
+
+        int first_line = obj_y_offs - OBJ_GLOBAL_Y_OFFSET;
+        int last_line  = first_line + obj_height - 1;
 
-        if (obj_y_offs - OBJ_GLOBAL_Y_OFFSET <= ppu->reg_ly &&
-            ppu->reg_ly < obj_y_offs - OBJ_GLOBAL_Y_OFFSET + obj_height)
+        if (first_line < 0)
+            first_line = 0;
+
+        if (last_line >= GB_SCREEN_HEIGHT)
+            last_line = GB_SCREEN_HEIGHT - 1;
+
+        // Less value - higher priority
+        int priority = (obj_x_offs << 8) | i;
+
+        for (int line = first_line; line <= last_line; line++)
         {
-            // Less value - higher priority
-            ppu->sprite_draw_order[ppu->line_sprite_count++] = (obj_x_offs << 8) | i;
+            // Only first sprites in OAM order are drawn on a line
+            int *bucket = ppu->sprite_buckets[line];
+            int  size   = ppu->sprite_bucket_sizes[line];
+            if (size >= MAX_SPRITE_PER_LINE)
+                continue;
+
+            // Draw order - priorities from less to high, kept by insertion
+            int pos = size;
+            while (pos > 0 && bucket[pos - 1] < priority)
+            {
+                bucket[pos] = bucket[pos - 1];
+                pos--;
+            }
 
-            if (ppu->line_sprite_count >= MAX_SPRITE_PER_LINE)
-                break;
+            bucket[pos] = priority;
+            ppu->sprite_bucket_sizes[line] = size + 1;
         }
     }
 
-    // Draw order - priorities from less to high
-    qsort(ppu->sprite_draw_order, ppu->line_sprite_count, sizeof(int), ppu_draw_order_cmp);
+    ppu->sprite_buckets_obj_height = obj_height;
+    ppu->sprite_buckets_dirty      = false;
 }
\ No newline at end of file
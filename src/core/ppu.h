@@ -4,12 +4,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "gbstatus.h"
+#include "compositor.h"
 
 #define GB_SCREEN_WIDTH 160
 #define GB_SCREEN_HEIGHT 144
 
 #define MAX_SPRITE_PER_LINE 10
 
+/// OAM DMA transfer length in clock cycles, one byte per 4 cycles
+#define PPU_DMA_DURATION (0xA0 * 4)
+
+/// Maximum number of VRAM writes recorded between deferred renders
+#define PPU_VRAM_LOG_SIZE 0x4000
+
 struct gb;
 
 typedef enum
@@ -24,6 +31,41 @@ typedef enum
     STATE_VBLANK_LAST_LINE_INC
 } ppu_state_e;
 
+/**
+ * Register state a scanline is rendered with
+ */
+typedef struct
+{
+    uint8_t ly;
+    uint8_t lcdc;
+    uint8_t scx;
+    uint8_t scy;
+    uint8_t wx;
+    uint8_t bgp;
+    uint8_t obp0;
+    uint8_t obp1;
+
+    /// Window line drawn on this scanline, -1 if the window isn't drawn
+    int window_line;
+
+    int sprite_count;
+
+    /// OAM entries of the sprites on this scanline in draw order
+    uint8_t sprites[MAX_SPRITE_PER_LINE][4];
+
+    /// Number of logged VRAM writes made before this scanline (deferred rendering only)
+    int vram_log_pos;
+} ppu_line_state_t;
+
+/**
+ * Logged VRAM write
+ */
+typedef struct
+{
+    uint16_t offset;
+    uint8_t  value;
+} ppu_vram_write_t;
+
 /**
  * Gameboy PPU representation
  */
@@ -55,6 +97,9 @@ typedef struct gb_ppu
     uint8_t *vram;
     uint8_t *oam;
 
+    /// Tile data decoded to palette indices, kept in sync with VRAM
+    uint8_t *tile_cache;
+
     /// Internal window line counter
     int window_line;
 
@@ -77,11 +122,67 @@ typedef struct gb_ppu
     /// Holds original BG and Window colors to handle OBJ priority bit
     char *bg_scanline_buffer;
 
+    gb_compositor_t compositor;
+
     int sprite_draw_order[MAX_SPRITE_PER_LINE];
 
     /// Draw order size
     int line_sprite_count;
 
+    /// Draw orders of all scanlines, rebuilt only when sprite positions or size change
+    int sprite_buckets[GB_SCREEN_HEIGHT][MAX_SPRITE_PER_LINE];
+    int sprite_bucket_sizes[GB_SCREEN_HEIGHT];
+
+    /// Sprite height the buckets were built for
+    int sprite_buckets_obj_height;
+    bool sprite_buckets_dirty;
+
+    /// OAM DMA is in progress, the CPU can only access HRAM and I/O registers
+    bool dma_active;
+
+    /// OAM DMA source address
+    uint16_t dma_source;
+
+    /// Master clock value the OAM DMA was started at
+    uint64_t dma_start;
+
+    /// Number of bytes already copied to OAM
+    int dma_progress;
+
+    /// If true, scanlines are only recorded during the frame and rendered at VBlank
+    bool deferred_render;
+
+    /// Whether the next frame is rendered
+    bool render_enabled;
+
+    /// Whether the current frame is rendered, latched from render_enabled when the frame starts
+    bool render_frame;
+
+    /// Whether the ready frame differs from the previous one
+    bool frame_changed;
+
+    /// Whether any scanline of the current frame differs from the previous frame
+    bool lines_changed;
+
+    /// Whether the blank frame of the turned off LCD is already in the framebuffer,
+    /// following frames are reported as unchanged until the LCD is turned on
+    bool screen_blank;
+
+    /// Scanline being composed, compared to the framebuffer before being stored
+    char composed_line[GB_SCREEN_WIDTH];
+
+    /// Recorded scanlines waiting to be rendered
+    ppu_line_state_t *line_log;
+    int line_log_size;
+
+    /// VRAM writes not yet seen by the deferred renderer
+    ppu_vram_write_t *vram_log;
+    int vram_log_size;
+
+    /// VRAM and decoded tiles as seen by the deferred renderer
+    uint8_t *render_vram;
+    uint8_t *render_tile_cache;
+
     /// Pointer to the parent Gameboy structure
     struct gb *gb;
 } gb_ppu_t;
@@ -109,6 +210,15 @@ void ppu_reset(gb_ppu_t *ppu);
  */
 void ppu_update(gb_ppu_t *ppu, int elapsed_cycles);
 
+/**
+ * Returns the number of clock cycles until the next PPU state change. 
+ * ppu_update calls which don't reach it have no side effects
+ * 
+ * \param ppu PPU instance
+ * \return Clock cycles
+ */
+int ppu_cycles_to_next_state(gb_ppu_t *ppu);
+
 /**
  * Emulates LCDC register reading
  * 
@@ -312,14 +422,21 @@ void ppu_obp0_write(gb_ppu_t *ppu, uint8_t value);
 void ppu_obp1_write(gb_ppu_t *ppu, uint8_t value);
 
 /**
- * Emulates writing to the DMA register
+ * Emulates writing to the DMA register. Starts the OAM DMA transfer
  * 
  * \param ppu PPU instance
- * \param addr Address to write
- * \param byte Byte to write
+ * \param value Value to write
  */
 void ppu_dma_write(gb_ppu_t *ppu, uint8_t value);
 
+/**
+ * Brings the OAM DMA transfer up to the master clock. 
+ * Bytes nobody could observe yet are copied in bulk
+ * 
+ * \param ppu PPU instance
+ */
+void ppu_dma_sync(gb_ppu_t *ppu);
+
 /**
  * Emulates a memory write request to the VRAM
  * 
@@ -338,6 +455,25 @@ void ppu_vram_write(gb_ppu_t *ppu, uint16_t addr, uint8_t byte);
  */
 void ppu_oam_write(gb_ppu_t *ppu, uint16_t addr, uint8_t byte);
 
+/**
+ * Switches between rendering every scanline as soon as it is drawn by the PPU
+ * and rendering the whole frame at VBlank. Both modes produce the same frames
+ * 
+ * \param ppu PPU instance
+ * \param enabled True to render the whole frame at VBlank
+ */
+void ppu_set_deferred_render(gb_ppu_t *ppu, bool enabled);
+
+/**
+ * Enables or disables pixel generation starting from the next frame.
+ * Timings, interrupts and the framebuffer ready flag are not affected,
+ * the framebuffer just keeps the last rendered frame
+ * 
+ * \param ppu PPU instance
+ * \param enabled True to render frames
+ */
+void ppu_set_render_enabled(gb_ppu_t *ppu, bool enabled);
+
 /**
  * Deinitializes the instance of the PPU
  * 
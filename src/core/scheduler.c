@@ -0,0 +1,109 @@
+#include <assert.h>
+#include <limits.h>
+#include "scheduler.h"
+#include "gb.h"
+
+/**
+ * Converts the relative event time to the absolute one
+ *
+ * \param sched Scheduler instance
+ * \param cycles Clock cycles until the event, INT_MAX if it never happens
+ * \return Event time
+ */
+static uint64_t scheduler_event_time(gb_scheduler_t *sched, int cycles);
+
+/**
+ * Finds the earliest pending event
+ *
+ * \param sched Scheduler instance
+ */
+static void scheduler_update_next_event(gb_scheduler_t *sched);
+
+void scheduler_init(gb_scheduler_t *sched, struct gb *gb)
+{
+    assert(sched != NULL);
+    assert(gb    != NULL);
+
+    sched->gb = gb;
+    scheduler_reset(sched);
+}
+
+void scheduler_reset(gb_scheduler_t *sched)
+{
+    assert(sched != NULL);
+
+    sched->now       = 0;
+    sched->last_sync = 0;
+
+    // Peripherals might have been reset to a due state,
+    // so everything is rescheduled on the first sync
+    for (int i = 0; i < SCHED_EVENT_COUNT; i++)
+        sched->events[i] = 0;
+
+    sched->events[SCHED_EVENT_DEADLINE] = SCHED_NEVER;
+    sched->next_event = 0;
+}
+
+void scheduler_sync(gb_scheduler_t *sched)
+{
+    assert(sched != NULL);
+
+    gb_t *gb = sched->gb;
+
+    int elapsed_cycles = sched->now - sched->last_sync;
+    sched->last_sync = sched->now;
+
+    if (elapsed_cycles != 0)
+    {
+        timer_update(&gb->timer);
+        ppu_update(&gb->ppu, elapsed_cycles);
+        ppu_dma_sync(&gb->ppu);
+        apu_update(&gb->apu);
+    }
+
+    scheduler_reschedule(sched);
+}
+
+void scheduler_reschedule(gb_scheduler_t *sched)
+{
+    assert(sched != NULL);
+
+    gb_t *gb = sched->gb;
+
+    sched->events[SCHED_EVENT_PPU]   = scheduler_event_time(sched, ppu_cycles_to_next_state(&gb->ppu));
+    sched->events[SCHED_EVENT_TIMER] = gb->timer.overflow_time;
+    sched->events[SCHED_EVENT_DMA]   = gb->ppu.dma_active ? gb->ppu.dma_start + PPU_DMA_DURATION : SCHED_NEVER;
+    sched->events[SCHED_EVENT_APU]   = gb->apu.next_sync_time;
+
+    scheduler_update_next_event(sched);
+}
+
+void scheduler_set_deadline(gb_scheduler_t *sched, uint64_t deadline)
+{
+    assert(sched != NULL);
+
+    sched->events[SCHED_EVENT_DEADLINE] = deadline;
+    scheduler_update_next_event(sched);
+}
+
+static void scheduler_update_next_event(gb_scheduler_t *sched)
+{
+    sched->next_event = sched->events[0];
+    for (int i = 1; i < SCHED_EVENT_COUNT; i++)
+    {
+        if (sched->events[i] < sched->next_event)
+            sched->next_event = sched->events[i];
+    }
+}
+
+static uint64_t scheduler_event_time(gb_scheduler_t *sched, int cycles)
+{
+    if (cycles == INT_MAX)
+        return SCHED_NEVER;
+
+    // Overdue events are handled on the next clock advance
+    if (cycles <= 0)
+        return sched->last_sync;
+
+    return sched->last_sync + cycles;
+}
@@ -0,0 +1,124 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include "gbstatus.h"
+
+struct gb;
+
+/// Time of an event which is never going to happen
+#define SCHED_NEVER UINT64_MAX
+
+/**
+ * Peripheral events which must be emulated exactly on time
+ */
+typedef enum
+{
+    /// PPU mode change (may request STAT/VBlank interrupts and finish the frame)
+    SCHED_EVENT_PPU,
+
+    /// TIMA overflow (requests the timer interrupt)
+    SCHED_EVENT_TIMER,
+
+    /// End of the OAM DMA transfer (lifts the CPU bus restriction)
+    SCHED_EVENT_DMA,
+
+    /// Periodic sound synthesis (keeps the APU buffer from overflowing)
+    SCHED_EVENT_APU,
+
+    /// End of the cycle budget given to the CPU, keeps fast-forwarding from passing it
+    SCHED_EVENT_DEADLINE,
+
+    SCHED_EVENT_COUNT
+} sched_event_e;
+
+/**
+ * Master clock and pending peripheral events.
+ *
+ * The CPU only advances the master clock. Peripherals are brought up to date
+ * lazily - when an event comes due or when their registers are accessed.
+ * Between events peripheral updates have no side effects, so this gives the same
+ * results as updating them on every memory access.
+ */
+typedef struct gb_scheduler
+{
+    /// Master clock in clock cycles
+    uint64_t now;
+
+    /// Time peripherals were last brought up to date
+    uint64_t last_sync;
+
+    /// Time of the earliest pending event
+    uint64_t next_event;
+
+    /// Pending event times
+    uint64_t events[SCHED_EVENT_COUNT];
+
+    /// Pointer to the parent Gameboy structure
+    struct gb *gb;
+} gb_scheduler_t;
+
+/**
+ * Initializes the instance of the scheduler
+ *
+ * \param sched Scheduler instance
+ * \param gb Parent GB instance
+ */
+void scheduler_init(gb_scheduler_t *sched, struct gb *gb);
+
+/**
+ * Resets the master clock. Must be called after resetting peripherals.
+ *
+ * \param sched Scheduler instance
+ */
+void scheduler_reset(gb_scheduler_t *sched);
+
+/**
+ * Brings peripherals up to date and handles due events
+ *
+ * \param sched Scheduler instance
+ */
+void scheduler_sync(gb_scheduler_t *sched);
+
+/**
+ * Recalculates event times, must be called when peripheral state
+ * affecting them is changed (TIMA, TAC, LCDC, etc.)
+ *
+ * \param sched Scheduler instance
+ */
+void scheduler_reschedule(gb_scheduler_t *sched);
+
+/**
+ * Sets the time the CPU has to stop at
+ *
+ * \param sched Scheduler instance
+ * \param deadline Master clock value, SCHED_NEVER if there is no deadline
+ */
+void scheduler_set_deadline(gb_scheduler_t *sched, uint64_t deadline);
+
+/**
+ * Advances the master clock
+ *
+ * \param sched Scheduler instance
+ * \param elapsed_cycles Clock cycles elapsed
+ */
+static inline void scheduler_advance(gb_scheduler_t *sched, int elapsed_cycles)
+{
+    sched->now += elapsed_cycles;
+
+    if (sched->now >= sched->next_event)
+        scheduler_sync(sched);
+}
+
+/**
+ * Returns the number of clock cycles until the next event
+ *
+ * \param sched Scheduler instance
+ * \return Clock cycles, 0 if an event is due
+ */
+static inline uint64_t scheduler_cycles_to_event(gb_scheduler_t *sched)
+{
+    return sched->next_event > sched->now ? sched->next_event - sched->now : 0;
+}
+
+#endif
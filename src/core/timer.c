@@ -5,21 +5,73 @@
 /// Divider increment period in clock cycles
 #define DIV_TICK_PERIOD 256
 
-// Timer increment periods in clock cycles
-static int timer_periods[] =
+/// TIMA increments on falling edges of the internal divider bit selected by TAC
+static const int timer_period_shifts[] =
 {
-    1024, // 00
-    16,   // 01
-    64,   // 10
-    256   // 11
+    10, // 00 - 1024 cycles
+    4,  // 01 - 16 cycles
+    6,  // 10 - 64 cycles
+    8   // 11 - 256 cycles
 };
 
+MMU_IO_HANDLERS(timer_div , gb_timer_t)
+MMU_IO_HANDLERS(timer_tima, gb_timer_t)
+MMU_IO_HANDLERS(timer_tma , gb_timer_t)
+MMU_IO_HANDLERS(timer_tac , gb_timer_t)
+
+/**
+ * Returns the number of clock cycles counted by the internal divider since its reset
+ *
+ * \param timer Timer instance
+ * \param time Master clock value
+ * \return Cycles, lower 16 bits are the divider value
+ */
+static inline uint64_t timer_divider(gb_timer_t *timer, uint64_t time);
+
+/**
+ * Checks whether the divider bit selected by TAC is set and the timer is enabled,
+ * TIMA increments when this signal goes low
+ *
+ * \param timer Timer instance
+ * \param tac TAC register value
+ * \return Signal state
+ */
+static inline bool timer_signal(gb_timer_t *timer, uint8_t tac);
+
+/**
+ * Advances TIMA up to the current master clock value
+ *
+ * \param timer Timer instance
+ */
+static void timer_sync(gb_timer_t *timer);
+
+/**
+ * Adds increments to TIMA, reloading it from TMA and requesting the interrupt on overflows
+ *
+ * \param timer Timer instance
+ * \param ticks Number of increments
+ */
+static void timer_add_ticks(gb_timer_t *timer, uint64_t ticks);
+
+/**
+ * Calculates the time of the next TIMA overflow
+ *
+ * \param timer Timer instance
+ */
+static void timer_schedule_overflow(gb_timer_t *timer);
+
 void timer_init(gb_timer_t *timer, struct gb *gb)
 {
     assert(timer != NULL);
     assert(gb != NULL);
 
     timer->gb = gb;
+
+    mmu_register_io(&gb->mmu, 0xFF04, timer_div_io_read , timer_div_io_write , timer);
+    mmu_register_io(&gb->mmu, 0xFF05, timer_tima_io_read, timer_tima_io_write, timer);
+    mmu_register_io(&gb->mmu, 0xFF06, timer_tma_io_read , timer_tma_io_write , timer);
+    mmu_register_io(&gb->mmu, 0xFF07, timer_tac_io_read , timer_tac_io_write , timer);
+
     timer_reset(timer);
 }
 
@@ -27,33 +79,46 @@ void timer_reset(gb_timer_t *timer)
 {
     assert(timer != NULL);
 
-    timer->reg_div  = 0x00;
     timer->reg_tima = 0;
     timer->reg_tma  = 0;
     timer->reg_tac  = 0;
 
-    timer->div_cycles   = 0;
-    timer->timer_cycles = 0;
+    // Master clock is reset together with the timer
+    timer->div_reset_time = 0;
+    timer->tima_sync_time = 0;
+    timer->overflow_time  = SCHED_NEVER;
 }
 
 void timer_div_write(gb_timer_t *timer, uint8_t value)
 {
     assert(timer != NULL);
 
-    timer->reg_div = 0x00;
+    timer_sync(timer);
+
+    // Resetting the divider drops the selected bit
+    if (timer_signal(timer, timer->reg_tac))
+        timer_add_ticks(timer, 1);
+
+    timer->div_reset_time = timer->gb->scheduler.now;
+    timer_schedule_overflow(timer);
 }
 
 void timer_tima_write(gb_timer_t *timer, uint8_t value)
 {
     assert(timer != NULL);
     
+    timer_sync(timer);
+
     timer->reg_tima = value;
+    timer_schedule_overflow(timer);
 }
 
 void timer_tma_write(gb_timer_t *timer, uint8_t value)
 {
     assert(timer != NULL);
 
+    timer_sync(timer);
+
     timer->reg_tma = value;
 }
 
@@ -61,20 +126,28 @@ void timer_tac_write(gb_timer_t *timer, uint8_t value)
 {
     assert(timer != NULL);
 
+    timer_sync(timer);
+
+    // Disabling the timer or switching to a cleared bit is a falling edge too
+    if (timer_signal(timer, timer->reg_tac) && !timer_signal(timer, value))
+        timer_add_ticks(timer, 1);
+
     timer->reg_tac = value;
+    timer_schedule_overflow(timer);
 }
 
 uint8_t timer_div_read(gb_timer_t *timer)
 {
     assert(timer != NULL);
 
-    return timer->reg_div;
+    return (timer_divider(timer, timer->gb->scheduler.now) >> 8) & 0xFF;
 }
 
 uint8_t timer_tima_read(gb_timer_t *timer)
 {
     assert(timer != NULL);
 
+    timer_sync(timer);
     return timer->reg_tima;
 }
 
@@ -92,32 +165,84 @@ uint8_t timer_tac_read(gb_timer_t *timer)
     return timer->reg_tac;
 }
 
-void timer_update(gb_timer_t *timer, int elapsed_cycles)
+void timer_update(gb_timer_t *timer)
 {
     assert(timer != NULL);
 
-    timer->div_cycles += elapsed_cycles;
-    int div_ticks = timer->div_cycles / DIV_TICK_PERIOD;
-    timer->div_cycles %= DIV_TICK_PERIOD;
+    // Nothing observable happens before the overflow
+    if (timer->gb->scheduler.now >= timer->overflow_time)
+        timer_sync(timer);
+}
+
+int timer_cycles_to_div_tick(gb_timer_t *timer)
+{
+    assert(timer != NULL);
+
+    return DIV_TICK_PERIOD - timer_divider(timer, timer->gb->scheduler.now) % DIV_TICK_PERIOD;
+}
+
+static inline uint64_t timer_divider(gb_timer_t *timer, uint64_t time)
+{
+    return time - timer->div_reset_time;
+}
+
+static inline bool timer_signal(gb_timer_t *timer, uint8_t tac)
+{
+    if (!(tac & 0x04))
+        return false;
 
-    timer->reg_div += div_ticks;
+    int shift = timer_period_shifts[tac & 0x3];
+    return (timer_divider(timer, timer->gb->scheduler.now) >> (shift - 1)) & 0x1;
+}
+
+static void timer_sync(gb_timer_t *timer)
+{
+    uint64_t now = timer->gb->scheduler.now;
 
     if (timer->reg_tac & 0x04)
     {
-        // Timer is enabled
+        // Every period boundary crossed is a falling edge of the selected bit
+        int shift = timer_period_shifts[timer->reg_tac & 0x3];
 
-        int timer_period = timer_periods[timer->reg_tac & 0x3];
+        uint64_t ticks = (timer_divider(timer, now) >> shift) -
+                         (timer_divider(timer, timer->tima_sync_time) >> shift);
 
-        timer->timer_cycles += elapsed_cycles;
-        int timer_ticks = timer->timer_cycles / timer_period;
-        timer->timer_cycles %= timer_period;
+        timer->tima_sync_time = now;
 
-        if (timer->reg_tima + timer_ticks > 255)
+        if (ticks != 0)
         {
-            timer->reg_tima = timer->reg_tma;
-            int_request(&timer->gb->intr_ctrl, INT_TIMA);
+            timer_add_ticks(timer, ticks);
+            timer_schedule_overflow(timer);
         }
-        else
-            timer->reg_tima += timer_ticks;
     }
-}
\ No newline at end of file
+    else
+        timer->tima_sync_time = now;
+}
+
+static void timer_add_ticks(gb_timer_t *timer, uint64_t ticks)
+{
+    while (ticks >= (uint64_t)(256 - timer->reg_tima))
+    {
+        ticks -= 256 - timer->reg_tima;
+
+        timer->reg_tima = timer->reg_tma;
+        int_request(&timer->gb->intr_ctrl, INT_TIMA);
+    }
+
+    timer->reg_tima += ticks;
+}
+
+static void timer_schedule_overflow(gb_timer_t *timer)
+{
+    if (!(timer->reg_tac & 0x04))
+    {
+        timer->overflow_time = SCHED_NEVER;
+        return;
+    }
+
+    int shift = timer_period_shifts[timer->reg_tac & 0x3];
+
+    // Overflow happens on the (256 - TIMA)-th period boundary from now
+    uint64_t periods = (timer_divider(timer, timer->tima_sync_time) >> shift) + 256 - timer->reg_tima;
+    timer->overflow_time = timer->div_reset_time + (periods << shift);
+}
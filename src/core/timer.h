@@ -7,20 +7,27 @@
 struct gb;
 
 /**
- * Represents timer and divider. 
+ * Represents timer and divider.
+ *
+ * DIV is the upper byte of a 16-bit internal divider running at the master clock,
+ * so the divider is derived from the master clock and the time it was last reset at.
+ * TIMA is brought up to date only on register accesses and on overflows,
+ * the next overflow time is known exactly in advance.
  */
 typedef struct gb_timer
 {
-    uint8_t reg_div;
     uint8_t reg_tima;
     uint8_t reg_tma;
     uint8_t reg_tac;
 
-    /// Clock cycles counter for updating divider
-    int div_cycles;
+    /// Master clock value the internal divider was last reset at
+    uint64_t div_reset_time;
 
-    /// Clock cycles counter for updating timer
-    int timer_cycles;
+    /// Master clock value TIMA is up to date with
+    uint64_t tima_sync_time;
+
+    /// Master clock value of the next TIMA overflow, SCHED_NEVER if the timer is disabled
+    uint64_t overflow_time;
 
     /// Pointer to the parent Gameboy structure
     struct gb *gb;
@@ -106,11 +113,18 @@ uint8_t timer_tma_read(gb_timer_t *timer);
 uint8_t timer_tac_read(gb_timer_t *timer);
 
 /**
- * Updates state of the timer according to elapsed cycles
+ * Brings the timer up to date if TIMA overflow is due
+ * 
+ * \param timer Timer instance
+ */
+void timer_update(gb_timer_t *timer);
+
+/**
+ * Returns the number of clock cycles until the next DIV increment
  * 
  * \param timer Timer instance
- * \param elapsed_cycles Clock cycles delta
+ * \return Clock cycles
  */
-void timer_update(gb_timer_t *timer, int elapsed_cycles);
+int timer_cycles_to_div_tick(gb_timer_t *timer);
 
 #endif
\ No newline at end of file
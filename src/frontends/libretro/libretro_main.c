@@ -1,4 +1,5 @@
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include "libretro.h"
 #include "gb_emu.h"
@@ -8,6 +9,9 @@
 
 #define MAX_LOG_MSG_LEN  200
 
+/// Maximum number of frames skipped in a row by auto frameskip
+#define FRAMESKIP_MAX 3
+
 /// Minimum level of log messages displayed on the screen
 #define OSD_LOG_LEVEL LOG_INFO
 
@@ -60,12 +64,27 @@ static bool core_initialized = false;
 
 static gb_emu_t gb_emu = {0};
 
-static       char *out_framebuffer    = NULL;
-static const char *gb_framebuffer     = NULL;
-static const bool *gb_frame_ready_ptr = NULL;
+static char *out_framebuffer = NULL;
+
+/// Sound of one frame, passed to the frontend in a single batch
+static int16_t audio_buffer[APU_BUFFER_SIZE * 2];
+
+/// Sound settings passed to the core, same as its defaults initially
+static apu_mode_e audio_mode         = APU_MODE_FULL;
+static int        audio_sample_rate  = APU_DEFAULT_SAMPLE_RATE;
+static bool       audio_rate_changed = false;
+
+/// Frontend can show the previous frame again if NULL is passed to video_cb
+static bool can_dupe = false;
+
+/// out_framebuffer has to be presented even if the frame hasn't changed
+static bool output_updated = true;
 
 static bool skip_bootrom = false;
 
+/// Auto frameskip limit passed to the core, 0 if frameskip is disabled
+static int frameskip_max = 0;
+
 static const fb_color_t *curr_color_scheme = GB_SCREEN_COLORS_GRAY;
 
 
@@ -80,6 +99,12 @@ static void osd_msg(const char *fmt, ...);
 /// gb-to-libretro log proxy
 static void log_handler(gb_log_level_e level, const char *fmt, va_list args);
 
+/// Makes the core draw to out_framebuffer with the current color scheme
+static void update_output();
+
+/// Feeds host frame time to the auto frameskip
+static void frame_time_handler(retro_usec_t usec);
+
 /// Checks for updates to "Core Options"
 static void check_variables();
 
@@ -120,6 +145,10 @@ void retro_set_environment(retro_environment_t cb)
    {
       { "gb_color", "Screen coloring; Gray|Green" },
       { "gb_bootrom_skip", "Skip BootROM; false|true" },
+      { "gb_idle_loop_skip", "Skip idle loops; true|false" },
+      { "gb_frameskip", "Frameskip; disabled|auto" },
+      { "gb_audio", "Audio; full|low|off" },
+      { "gb_sample_rate", "Audio sample rate; 44100|48000" },
       { NULL, NULL }
    };
 
@@ -159,9 +188,6 @@ void retro_init()
    if (status != GBSTATUS_OK)
       goto error_handler0;
 
-   gb_framebuffer     = gb_emu_framebuffer_ptr(&gb_emu);
-   gb_frame_ready_ptr = gb_emu_frame_ready_ptr(&gb_emu);
-
    // XRGB8888
    out_framebuffer = calloc(GB_SCREEN_HEIGHT * GB_SCREEN_WIDTH * 4, sizeof(char));
    if (out_framebuffer == NULL)
@@ -170,6 +196,8 @@ void retro_init()
       goto error_handler1;
    }
 
+   update_output();
+
    core_initialized = true;
    return;
 
@@ -197,6 +225,15 @@ bool retro_load_game(const struct retro_game_info *info)
 
    check_variables();
 
+   // Frontend learns the rate from retro_get_system_av_info after loading
+   audio_rate_changed = false;
+
+   if (!env_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe))
+      can_dupe = false;
+
+   struct retro_frame_time_callback frame_time = { frame_time_handler, GB_FRAME_DURATION_US };
+   env_cb(RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK, &frame_time);
+
    struct retro_input_descriptor desc[] = {
       { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT  , "Left" },
       { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP    , "Up" },
@@ -243,7 +280,8 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
    info->geometry.max_height   = GB_SCREEN_HEIGHT;
    info->geometry.aspect_ratio = (float)GB_SCREEN_WIDTH / (float)GB_SCREEN_HEIGHT;
 
-   info->timing.fps = 60.0f;
+   info->timing.fps         = GB_FRAME_RATE;
+   info->timing.sample_rate = audio_sample_rate;
 }
 
 void retro_run()
@@ -254,6 +292,15 @@ void retro_run()
    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &var_updated) && var_updated)
       check_variables();
 
+   if (audio_rate_changed)
+   {
+      struct retro_system_av_info av_info;
+      retro_get_system_av_info(&av_info);
+
+      env_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &av_info);
+      audio_rate_changed = false;
+   }
+
    int joypad_state = 0;
 
    if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A))
@@ -282,29 +329,24 @@ void retro_run()
 
    gb_emu_update_input(&gb_emu, joypad_state);
 
-   while (!(*gb_frame_ready_ptr))
+   status = gb_emu_run_frame(&gb_emu, NULL);
+   if (status != GBSTATUS_OK)
    {
-      status = gb_emu_step(&gb_emu);
-      if (status != GBSTATUS_OK)
-      {
-         GBSTATUS_ERR_PRINT("Emulation error!");
-         return;
-      }
+      GBSTATUS_ERR_PRINT("Emulation error!");
+      return;
    }
 
+   // The core has already drawn the frame to out_framebuffer. While the LCD stays off
+   // it isn't redrawn, but frontends without dupe support still get the blank frame
+   bool dupe = can_dupe && !output_updated && !gb_emu_frame_changed(&gb_emu);
    gb_emu_grab_frame(&gb_emu);
 
-   for (int y = 0; y < GB_SCREEN_HEIGHT; y++)
-   {
-      for (int x = 0; x < GB_SCREEN_WIDTH; x++)
-      {
-         char gb_color = gb_framebuffer[y * GB_SCREEN_WIDTH + x];
-         memcpy(out_framebuffer + (y * GB_SCREEN_WIDTH + x) * 4, &curr_color_scheme[gb_color], sizeof(fb_color_t));
-      }
-   }
+   video_cb(dupe ? NULL : out_framebuffer, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, GB_SCREEN_WIDTH * 4);
+   output_updated = false;
 
-   video_cb(out_framebuffer, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, GB_SCREEN_WIDTH * 4);
-   audio_cb(0, 0);
+   int audio_samples = gb_emu_read_audio(&gb_emu, audio_buffer, APU_BUFFER_SIZE);
+   if (audio_samples > 0)
+      audio_batch_cb(audio_buffer, audio_samples);
 }
 
 unsigned int retro_get_region()
@@ -420,6 +462,8 @@ static void check_variables()
          curr_color_scheme = GB_SCREEN_COLORS_GRAY;
       else
          curr_color_scheme = GB_SCREEN_COLORS_GREEN;
+
+      update_output();
    }
 
    var.key = "gb_bootrom_skip";
@@ -430,4 +474,69 @@ static void check_variables()
       else
          skip_bootrom = false;
    }
-}
\ No newline at end of file
+
+   var.key = "gb_idle_loop_skip";
+   if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      gb_emu_set_idle_loop_skip(&gb_emu, !strcmp(var.value, "true"));
+
+   var.key = "gb_frameskip";
+   if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      int new_frameskip_max = !strcmp(var.value, "auto") ? FRAMESKIP_MAX : 0;
+
+      // Setting it resets the lag accounting
+      if (new_frameskip_max != frameskip_max)
+      {
+         frameskip_max = new_frameskip_max;
+         gb_emu_set_auto_frameskip(&gb_emu, frameskip_max);
+      }
+   }
+
+   int new_sample_rate = audio_sample_rate;
+
+   var.key = "gb_sample_rate";
+   if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      new_sample_rate = atoi(var.value);
+
+   apu_mode_e new_audio_mode = audio_mode;
+
+   var.key = "gb_audio";
+   if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "off"))
+         new_audio_mode = APU_MODE_OFF;
+      else if (!strcmp(var.value, "low"))
+         new_audio_mode = APU_MODE_LOW;
+      else
+         new_audio_mode = APU_MODE_FULL;
+   }
+
+   // Changing sound settings drops buffered sound
+   if (new_audio_mode != audio_mode || new_sample_rate != audio_sample_rate)
+   {
+      if (new_sample_rate != audio_sample_rate)
+         audio_rate_changed = true;
+
+      audio_mode        = new_audio_mode;
+      audio_sample_rate = new_sample_rate;
+      gb_emu_set_audio(&gb_emu, audio_mode, audio_sample_rate);
+   }
+}
+
+static void update_output()
+{
+   // fb_color_t already has the XRGB8888 memory layout
+   uint32_t palette[4];
+   memcpy(palette, curr_color_scheme, sizeof(palette));
+
+   gb_emu_set_output(&gb_emu, out_framebuffer, GB_SCREEN_WIDTH * sizeof(fb_color_t),
+                     COMPOSITOR_FORMAT_XRGB8888, palette);
+
+   // Unchanged frames still have to be shown with new colors
+   output_updated = true;
+}
+
+static void frame_time_handler(retro_usec_t usec)
+{
+   gb_emu_report_frame_time(&gb_emu, usec);
+}
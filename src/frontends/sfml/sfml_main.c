@@ -1,6 +1,8 @@
 #include <SFML/Graphics.h>
+#include <SFML/System.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "gb_emu.h"
 
 /// Reports status to the user with additional message
@@ -18,13 +20,51 @@ typedef struct
 {
     sfRenderWindow *sf_window;
 
-    sfImage   *sf_image;
     sfTexture *sf_texture;
     sfSprite  *sf_sprite;
+
+    /// Presents frames so emulation never waits for the display
+    sfThread *render_thread;
+    atomic_bool render_running;
+
+    gb_frame_queue_t frame_queue;
+
+    /// The core draws frames here in the texture pixel format
+    uint32_t pixels[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT];
 } sfml_frontend_t;
 
 #define SCREEN_SCALE 4
 
+/// Maximum number of frames skipped in a row when the host is too slow
+#define FRAMESKIP_MAX 3
+
+/**
+ * Render thread entry point.
+ * Uploads the latest published frame to the texture and presents it.
+ * 
+ * \param arg Frontend instance
+ */
+void render_thread_main(void *arg)
+{
+    sfml_frontend_t *frontend = arg;
+
+    sfRenderWindow_setActive(frontend->sf_window, sfTrue);
+
+    while (atomic_load(&frontend->render_running))
+    {
+        const void *frame = frame_queue_acquire(&frontend->frame_queue);
+        if (frame != NULL)
+            sfTexture_updateFromPixels(frontend->sf_texture, frame, GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT, 0, 0);
+
+        // Blocks according to the framerate limit
+        sfRenderWindow_clear(frontend->sf_window, sfBlack);
+        sfRenderWindow_drawSprite(frontend->sf_window, frontend->sf_sprite, NULL);
+        sfRenderWindow_display(frontend->sf_window);
+    }
+
+    sfRenderWindow_setActive(frontend->sf_window, sfFalse);
+}
+
 gbstatus_e init_sfml(sfml_frontend_t *frontend)
 {
     gbstatus_e status = GBSTATUS_OK;
@@ -38,22 +78,22 @@ gbstatus_e init_sfml(sfml_frontend_t *frontend)
         goto cleanup0;
     }
 
-    frontend->sf_image = sfImage_create(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
-    if (frontend->sf_image == NULL)
+    frontend->sf_texture = sfTexture_create(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
+    if (frontend->sf_texture == NULL)
     {
         GBSTATUS(GBSTATUS_SFML_FAIL, "unable to initialize SFML");
         goto cleanup1;
     }
 
-    frontend->sf_texture = sfTexture_create(GB_SCREEN_WIDTH, GB_SCREEN_HEIGHT);
-    if (frontend->sf_texture == NULL)
+    frontend->sf_sprite = sfSprite_create();
+    if (frontend->sf_sprite == NULL)
     {
         GBSTATUS(GBSTATUS_SFML_FAIL, "unable to initialize SFML");
         goto cleanup2;
     }
 
-    frontend->sf_sprite = sfSprite_create();
-    if (frontend->sf_sprite == NULL)
+    frontend->render_thread = sfThread_create(render_thread_main, frontend);
+    if (frontend->render_thread == NULL)
     {
         GBSTATUS(GBSTATUS_SFML_FAIL, "unable to initialize SFML");
         goto cleanup3;
@@ -62,13 +102,16 @@ gbstatus_e init_sfml(sfml_frontend_t *frontend)
     sfSprite_setPosition(frontend->sf_sprite, (sfVector2f){ 0, 0 });
     sfSprite_setScale   (frontend->sf_sprite, (sfVector2f){ SCREEN_SCALE, SCREEN_SCALE });
     sfSprite_setTexture (frontend->sf_sprite, frontend->sf_texture, false);
+
+    frame_queue_init(&frontend->frame_queue, sizeof(frontend->pixels));
+    atomic_init(&frontend->render_running, false);
     return GBSTATUS_OK;
 
 cleanup3:
-    sfTexture_destroy(frontend->sf_texture);
+    sfSprite_destroy(frontend->sf_sprite);
 
 cleanup2:
-    sfImage_destroy(frontend->sf_image);
+    sfTexture_destroy(frontend->sf_texture);
 
 cleanup1:
     sfRenderWindow_destroy(frontend->sf_window);
@@ -79,9 +122,9 @@ cleanup0:
 
 void deinit_sfml(sfml_frontend_t *frontend)
 {
+    sfThread_destroy(frontend->render_thread);
     sfSprite_destroy(frontend->sf_sprite);
     sfTexture_destroy(frontend->sf_texture);
-    sfImage_destroy(frontend->sf_image);
     sfRenderWindow_destroy(frontend->sf_window);
 }
 
@@ -89,7 +132,7 @@ gbstatus_e run(const char *rom_path)
 {
     gbstatus_e status = GBSTATUS_OK;
 
-    sfml_frontend_t frontend = {0};
+    static sfml_frontend_t frontend = {0};
     status = init_sfml(&frontend);
     if (status != GBSTATUS_OK)
         goto cleanup0;
@@ -104,9 +147,7 @@ gbstatus_e run(const char *rom_path)
     if (status != GBSTATUS_OK)
         goto cleanup2;
 
-    const char *game_title      = gb_emu_game_title_ptr (&gb_emu);
-    const char *framebuffer     = gb_emu_framebuffer_ptr(&gb_emu);
-    const bool *frame_ready_ptr = gb_emu_frame_ready_ptr(&gb_emu);
+    const char *game_title  = gb_emu_game_title_ptr (&gb_emu);
 
     char window_title[GAME_TITLE_LEN + 20];
     strncpy(window_title, game_title, GAME_TITLE_LEN);
@@ -115,13 +156,40 @@ gbstatus_e run(const char *rom_path)
 
     sfRenderWindow_setFramerateLimit(frontend.sf_window, 60);
 
-    while (sfRenderWindow_isOpen(frontend.sf_window))
+    // sfColor has the memory layout of texture pixels
+    uint32_t palette[4];
+    memcpy(palette, gb_screen_colors, sizeof(palette));
+
+    gb_emu_set_output(&gb_emu, frontend.pixels, GB_SCREEN_WIDTH * sizeof(uint32_t),
+                      COMPOSITOR_FORMAT_XRGB8888, palette);
+
+    sfClock *clock = sfClock_create();
+    if (clock == NULL)
     {
+        GBSTATUS(GBSTATUS_SFML_FAIL, "unable to initialize SFML");
+        goto cleanup2;
+    }
+
+    // The window is drawn only by the render thread from now on,
+    // events are still processed here
+    sfRenderWindow_setActive(frontend.sf_window, sfFalse);
+    atomic_store(&frontend.render_running, true);
+    sfThread_launch(frontend.render_thread);
+
+    gb_emu_set_auto_frameskip(&gb_emu, FRAMESKIP_MAX);
+
+    sfInt64 next_frame_time = 0;
+    bool window_open = true;
+
+    while (window_open)
+    {
+        sfInt64 frame_start_time = sfTime_asMicroseconds(sfClock_getElapsedTime(clock));
+
         sfEvent event;
         while (sfRenderWindow_pollEvent(frontend.sf_window, &event))
         {
             if (event.type == sfEvtClosed)
-                sfRenderWindow_close(frontend.sf_window);
+                window_open = false;
         }
 
         int joypad_state = 0;
@@ -152,31 +220,33 @@ gbstatus_e run(const char *rom_path)
 
         gb_emu_update_input(&gb_emu, joypad_state);
 
-        while (!(*frame_ready_ptr))
-        {
-            status = gb_emu_step(&gb_emu);
-            if (status != GBSTATUS_OK)
-                goto cleanup2;
-        }
+        status = gb_emu_run_frame(&gb_emu, NULL);
+        if (status != GBSTATUS_OK)
+            goto cleanup3;
 
-        gb_emu_grab_frame(&gb_emu);
+        // The render thread keeps showing the last texture if nothing is published
+        if (gb_emu_frame_changed(&gb_emu))
+            gb_emu_publish_frame(&gb_emu, &frontend.frame_queue);
+        else
+            gb_emu_grab_frame(&gb_emu);
 
-        for (int y = 0; y < GB_SCREEN_HEIGHT; y++)
-        {
-            for (int x = 0; x < GB_SCREEN_WIDTH; x++)
-            {
-                int color = framebuffer[y * GB_SCREEN_WIDTH + x];
-                sfImage_setPixel(frontend.sf_image, x, y, gb_screen_colors[color]);
-            }
-        }
+        // Presentation doesn't throttle the emulation anymore, so it keeps the pace itself
+        next_frame_time += GB_FRAME_DURATION_US;
+
+        sfInt64 curr_time = sfTime_asMicroseconds(sfClock_getElapsedTime(clock));
+        gb_emu_report_frame_time(&gb_emu, curr_time - frame_start_time);
 
-        sfTexture_updateFromImage(frontend.sf_texture, frontend.sf_image, 0, 0);
-        
-        sfRenderWindow_clear(frontend.sf_window, sfBlack);
-        sfRenderWindow_drawSprite(frontend.sf_window, frontend.sf_sprite, NULL);
-        sfRenderWindow_display(frontend.sf_window);
+        if (curr_time < next_frame_time)
+            sfSleep(sfMicroseconds(next_frame_time - curr_time));
+        else
+            next_frame_time = curr_time;
     }
 
+cleanup3:
+    atomic_store(&frontend.render_running, false);
+    sfThread_wait(frontend.render_thread);
+    sfClock_destroy(clock);
+
 cleanup2:
     gb_emu_deinit(&gb_emu);
 
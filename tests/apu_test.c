@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include "gb_emu.h"
+
+/**
+ * Checks that writes to every sound register, including the unused ones,
+ * stay within the register file and the channel they belong to.
+ * Games commonly clear the whole 0xFF10-0xFF3F range in a loop.
+ */
+
+#define SOUND_REGS_START 0xFF10
+#define SOUND_REGS_END   0xFF40
+
+#define UNUSED_REGS_START 0xFF27
+#define UNUSED_REGS_END   0xFF30
+
+static gb_emu_t gb_emu;
+
+int main()
+{
+    gb_log_set_handler(NULL);
+
+    if (gb_emu_init(&gb_emu) != GBSTATUS_OK)
+    {
+        printf("Unable to initialize the emulator: %s\n", gbstatus_str);
+        return 1;
+    }
+
+    gb_apu_t *apu = &gb_emu.gb.apu;
+    int failures = 0;
+
+    // State following the channels must not be touched by register writes
+    int      frame_seq_step = apu->frame_seq_step;
+    uint64_t next_frame_seq = apu->next_frame_seq;
+    uint64_t last_time      = apu->last_time;
+    uint64_t next_sync_time = apu->next_sync_time;
+
+    // All bits set keeps the APU powered and triggers every channel
+    for (uint16_t addr = SOUND_REGS_START; addr < SOUND_REGS_END; addr++)
+        mmu_write(&gb_emu.gb.mmu, addr, 0xFF);
+
+    if (apu->frame_seq_step != frame_seq_step || apu->next_frame_seq != next_frame_seq ||
+        apu->last_time != last_time || apu->next_sync_time != next_sync_time)
+    {
+        printf("APU state is overwritten by register writes\n");
+        failures++;
+    }
+
+    for (uint16_t addr = UNUSED_REGS_START; addr < UNUSED_REGS_END; addr++)
+    {
+        mmu_write(&gb_emu.gb.mmu, addr, 0x00);
+
+        uint8_t value = mmu_read(&gb_emu.gb.mmu, addr);
+        if (value != 0xFF)
+        {
+            printf("0x%04X reads 0x%02X, expected 0xFF\n", addr, value);
+            failures++;
+        }
+    }
+
+    printf("sound registers: %s\n", failures == 0 ? "OK" : "FAILED");
+
+    gb_emu_deinit(&gb_emu);
+    return failures == 0 ? 0 : 1;
+}
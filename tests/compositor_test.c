@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include "gb_emu.h"
+
+/**
+ * Checks that every compositor implementation supported by the host CPU renders
+ * recorded PPU snapshots exactly like the scalar one.
+ *
+ * Snapshot layout: VRAM (0x2000 bytes), OAM (0xA0 bytes), then
+ * LCDC, SCY, SCX, WY, WX, BGP, OBP0, OBP1 register values.
+ * Snapshots were taken at the end of frames of the test ROMs.
+ */
+
+#define SNAPSHOT_VRAM_SIZE 0x2000
+#define SNAPSHOT_OAM_SIZE  0xA0
+#define SNAPSHOT_REGS_SIZE 8
+#define SNAPSHOT_SIZE (SNAPSHOT_VRAM_SIZE + SNAPSHOT_OAM_SIZE + SNAPSHOT_REGS_SIZE)
+
+#define SNAPSHOT_COUNT 4
+
+#define LCDC_PPU_ON 0x80
+
+/// Each snapshot is also rendered with these LCDC bits flipped: none, 8x16 sprites,
+/// signed tile data addressing, swapped BG and Window tilemaps
+static const uint8_t lcdc_variants[] = { 0x00, 0x04, 0x10, 0x48 };
+
+/// Distinct colors, so a wrong shade can't go unnoticed in the output
+static const uint32_t output_palette[4] = { 0x00E0F8D0, 0x0088C070, 0x00346856, 0x00081820 };
+
+static const char *impl_names[] = { "scalar", "SSE2", "AVX2" };
+
+typedef struct
+{
+    char     shades[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT];
+    uint32_t output[GB_SCREEN_WIDTH * GB_SCREEN_HEIGHT];
+} rendered_frame_t;
+
+static gb_emu_t gb_emu;
+
+/**
+ * Loads a snapshot
+ *
+ * \param dir Snapshot directory
+ * \param index Snapshot number
+ * \param snapshot Buffer of SNAPSHOT_SIZE bytes
+ * \return True on success
+ */
+static bool load_snapshot(const char *dir, int index, uint8_t *snapshot);
+
+/**
+ * Renders a frame of the snapshot with the given compositor implementation
+ *
+ * \param snapshot Snapshot
+ * \param lcdc_flip LCDC bits to flip
+ * \param impl Compositor implementation
+ * \param frame Rendered frame
+ * \return False if the implementation isn't supported by the host CPU
+ */
+static bool render_snapshot(const uint8_t *snapshot, uint8_t lcdc_flip, compositor_impl_e impl,
+                            rendered_frame_t *frame);
+
+/**
+ * Checks whether the host CPU can run the implementation
+ *
+ * \param impl Compositor implementation
+ * \return True if it's supported
+ */
+static bool impl_supported(compositor_impl_e impl);
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <snapshot directory>\n", argv[0]);
+        return 1;
+    }
+
+    gb_log_set_handler(NULL);
+
+    static uint8_t snapshot[SNAPSHOT_SIZE];
+    static rendered_frame_t reference, frame;
+
+    int failures = 0;
+
+    for (int i = 0; i < SNAPSHOT_COUNT; i++)
+    {
+        if (!load_snapshot(argv[1], i, snapshot))
+            return 1;
+
+        for (size_t v = 0; v < sizeof(lcdc_variants); v++)
+        {
+            render_snapshot(snapshot, lcdc_variants[v], COMPOSITOR_SCALAR, &reference);
+
+            for (compositor_impl_e impl = COMPOSITOR_SSE2; impl <= COMPOSITOR_AVX2; impl++)
+            {
+                if (!impl_supported(impl) || !render_snapshot(snapshot, lcdc_variants[v], impl, &frame))
+                {
+                    printf("snapshot %d, LCDC ^ 0x%02X, %s: skipped, not supported by the host CPU\n",
+                           i, lcdc_variants[v], impl_names[impl]);
+                    continue;
+                }
+
+                bool shades_match = memcmp(frame.shades, reference.shades, sizeof(frame.shades)) == 0;
+                bool output_match = memcmp(frame.output, reference.output, sizeof(frame.output)) == 0;
+
+                printf("snapshot %d, LCDC ^ 0x%02X, %s: %s\n", i, lcdc_variants[v], impl_names[impl],
+                       shades_match && output_match ? "OK" : "MISMATCH");
+
+                if (!shades_match || !output_match)
+                    failures++;
+            }
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+static bool load_snapshot(const char *dir, int index, uint8_t *snapshot)
+{
+    char path[256] = {0};
+    snprintf(path, sizeof(path), "%s/ppu_snapshot%d.bin", dir, index);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Unable to open %s\n", path);
+        return false;
+    }
+
+    size_t bytes_read = fread(snapshot, sizeof(uint8_t), SNAPSHOT_SIZE, file);
+    fclose(file);
+
+    if (bytes_read != SNAPSHOT_SIZE)
+    {
+        printf("%s is truncated\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static bool render_snapshot(const uint8_t *snapshot, uint8_t lcdc_flip, compositor_impl_e impl,
+                            rendered_frame_t *frame)
+{
+    if (gb_emu_init(&gb_emu) != GBSTATUS_OK)
+    {
+        printf("Unable to initialize the emulator: %s\n", gbstatus_str);
+        return false;
+    }
+
+    gb_ppu_t *ppu = &gb_emu.gb.ppu;
+
+    if (!compositor_select(&ppu->compositor, impl))
+    {
+        gb_emu_deinit(&gb_emu);
+        return false;
+    }
+
+    gb_emu_set_output(&gb_emu, frame->output, GB_SCREEN_WIDTH * sizeof(uint32_t),
+                      COMPOSITOR_FORMAT_XRGB8888, output_palette);
+
+    const uint8_t *vram = snapshot;
+    const uint8_t *oam  = snapshot + SNAPSHOT_VRAM_SIZE;
+    const uint8_t *regs = snapshot + SNAPSHOT_VRAM_SIZE + SNAPSHOT_OAM_SIZE;
+
+    // Memory is written with the LCD off, as games do
+    ppu_lcdc_write(ppu, 0);
+
+    for (int i = 0; i < SNAPSHOT_VRAM_SIZE; i++)
+        ppu_vram_write(ppu, 0x8000 + i, vram[i]);
+
+    for (int i = 0; i < SNAPSHOT_OAM_SIZE; i++)
+        ppu_oam_write(ppu, 0xFE00 + i, oam[i]);
+
+    ppu_scy_write (ppu, regs[1]);
+    ppu_scx_write (ppu, regs[2]);
+    ppu_wx_write  (ppu, regs[4]);
+    ppu_bgp_write (ppu, regs[5]);
+    ppu_obp0_write(ppu, regs[6]);
+    ppu_obp1_write(ppu, regs[7]);
+
+    // WY writes take effect from the next frame
+    ppu->reg_wy = regs[3];
+
+    ppu_lcdc_write(ppu, (regs[0] ^ lcdc_flip) | LCDC_PPU_ON);
+
+    while (!ppu->new_frame_ready)
+        ppu_update(ppu, 4);
+
+    memcpy(frame->shades, gb_emu_framebuffer_ptr(&gb_emu), sizeof(frame->shades));
+    gb_emu_grab_frame(&gb_emu);
+
+    gb_emu_deinit(&gb_emu);
+    return true;
+}
+
+static bool impl_supported(compositor_impl_e impl)
+{
+    switch (impl)
+    {
+    case COMPOSITOR_SCALAR:
+        return true;
+
+#ifdef COMPOSITOR_X86
+    case COMPOSITOR_SSE2:
+        return true;
+
+    case COMPOSITOR_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+
+    default:
+        return false;
+    }
+}